@@ -29,6 +29,18 @@
        R_reference = R_undisloc. Subsequently, R_reference = R_disloc from
        the previous time. This is repeated until the new R_disloc = R_reference.
 
+       Or, with -i ITERTOL, we do that loop here: both files are read
+       into memory, and R_reference <- R_undisloc + u(R_reference) is
+       repeated until the largest change in any atom is below ITERTOL
+       (or -n MAXITER sweeps).  Only the final geometry is written;
+       the history of the changes goes to stderr.  If it hasn't
+       converged after MAXITER sweeps, the last iterate is still
+       written, but we exit with status 1, so a script can tell.  The sweeps are
+       accelerated with Anderson mixing over the last -m HISTORY
+       iterates (default 5; 0 is the plain iteration above), which
+       falls back to a damped step whenever the residual grows; see
+       anderson.H.
+
 	   You need to be VERY CAREFUL to be consistent about
 	   what information you feed this routine--it does next to no
 	   checks on its own, so you can easily get nonsense out.
@@ -156,6 +168,53 @@
 	   We do 16384 integration steps (2^14... woohoo!) to make
 	   sure that we have something reasonable :)
 
+	   Alternatively (-g NGAUSS), we do composite Gauss-Legendre
+	   integration: NPANELS panels with NGAUSS points each.  The
+	   table entries inside a panel come from integrating the
+	   polynomial through the Gauss points; 32 panels of 8 points
+	   (256 evaluations) gets S and B to ~1e-13.  The integrals
+	   themselves live in angular.H.
+
+	   With -e TOLER, the Gauss panels are chosen adaptively instead:
+	   starting from 4 panels (or -p NPANELS), each is bisected until
+	   its two halves agree with it to relative error TOLER, so the
+	   work goes where (nn)^-1 changes quickly.  The number of panels
+	   and kernel evaluations actually used goes to stderr.
+
+	   Or (-x), skip the integration entirely and use the closed-form
+	   Stroh (sextic) solution from stroh.H: one 6th order polynomial
+	   solve per dislocation, and u(x) is evaluated directly from the
+	   complex roots p_alpha, so there are no theta tables.  This
+	   falls back to integration when the p_alpha are degenerate.
+	   -c integrates as usual and reports the difference between the
+	   two on stderr.
+
+	   With -C CACHEDIR, the theta tables (S, B, and u_xyz) are
+	   written to CACHEDIR under a hash of Cijkl, the dislocation
+	   frame, b and the integration settings; later runs with the
+	   same inputs memory-map that file and skip the integration.
+	   See cache.H.
+
+	   With -H, u_xyz(theta) is interpolated by cubic Hermite
+	   polynomials through the exact du/dtheta at each table entry,
+	   instead of linearly, so a much shorter table (e.g. -s 256)
+	   does as well; -H implies -g 8 unless -g or -e is given.
+
+	   Both files are read whole: mapped into memory, split into
+	   lines, and the numbers parsed in place (no scanf(); see
+	   slabfile.H and parse.H), giving exactly what sscanf("%lf")
+	   would.  With -j NTHREADS, the file is parsed in NTHREADS
+	   chunks at once, and the atoms are displaced and formatted by
+	   NTHREADS threads and written out in order, so the output does
+	   not depend on the number of threads.  See displace.H.
+
+	   Either input can also be a binary slab (slabfile.H; from
+	   make-slab -b, or an earlier run with -b), which is mapped
+	   straight into memory instead of parsed; the format is picked
+	   by the first byte of each file.  With -b, the output is
+	   written as a binary slab too, so the iterations above never
+	   print or parse a coordinate.
+
   Output:  If we're verbose, we'll output the theta dependence of u_i, and
            also the ln |x| prefactor.
 
@@ -182,6 +241,13 @@
 #include "elastic.H"
 #include "cell.H"
 #include "integrate.H"
+#include "angular.H"
+#include "stroh.H"
+#include "cache.H"
+#include "displace.H"
+#include "xyz.H"
+#include "slabfile.H"
+#include "anderson.H"
 
 // This is the permutation matrix; eps[i][j][k] =
 //  1: if ijk is an even permutation of (012)
@@ -201,48 +267,6 @@ inline double dot(double a[3], double b[3])
 }
 
 
-void m_theta(double theta, double m[3], double n[3], double mt[3]) 
-{
-  mt[0] = cos(theta)*m[0] + sin(theta)*n[0];
-  mt[1] = cos(theta)*m[1] + sin(theta)*n[1];
-  mt[2] = cos(theta)*m[2] + sin(theta)*n[2];
-}
-
-void n_theta(double theta, double m[3], double n[3], double nt[3]) 
-{
-  nt[0] = -sin(theta)*m[0] + cos(theta)*n[0];
-  nt[1] = -sin(theta)*m[1] + cos(theta)*n[1];
-  nt[2] = -sin(theta)*m[2] + cos(theta)*n[2];
-}
-
-void a_mult_b (double a[3], double b[3], double Cijkl[9][9],
-	       double ab[9]) 
-{
-  int i, j, k, l;
-  for (i=0; i<3; ++i)
-    for (j=0; j<3; ++j) {
-      ab[index(i,j)] = 0.;
-      for (k=0; k<3; ++k)
-	for (l=0; l<3; ++l)
-	  ab[index(i,j)] += a[k]*Cijkl[index(k,i)][index(j,l)]*b[l];
-    }
-}
-
-void a_mult_a (double a[3], double Cijkl[9][9], double aa[9]) 
-{
-  int i, j, k, l;
-  for (i=0; i<3; ++i) {
-    for (j=0; j<i; ++j)
-      aa[index(i,j)] = aa[index(j,i)];
-    for (   ; j<3; ++j) {
-      aa[index(i,j)] = 0.;
-      for (k=0; k<3; ++k)
-	for (l=0; l<3; ++l)
-	  aa[index(i,j)] += a[k]*Cijkl[index(k,i)][index(j,l)]*a[l];
-    }
-  }
-}
-
 void print_mat (double a[9]) 
 {
   int i, j;
@@ -258,7 +282,7 @@ void print_mat (double a[9])
 
 // Arguments first, then flags, then explanation.
 const int NUMARGS = 4;
-const char* ARGLIST = "[-hvt] [-s STEPS] cell infile undisloc reference";
+const char* ARGLIST = "[-hvt] [-s STEPS] [-g NGAUSS [-p NPANELS]] [-e TOLER] [-x | -c] [-H] [-C CACHEDIR] [-j NTHREADS] [-b] [-i ITERTOL [-n MAXITER] [-m HISTORY]] cell infile undisloc reference";
 
 const char* ARGEXPL = 
 " cell:      cell file (-h for format)\n\
@@ -267,6 +291,20 @@ const char* ARGEXPL =
   reference: reference crystal input XYZ file\n\
 \n\
   -s STEPS  number of integration steps\n\
+  -g NGAUSS  Gauss-Legendre integration, NGAUSS points per panel\n\
+  -p NPANELS number of Gauss panels (default 32; must divide STEPS)\n\
+  -e TOLER  adaptive Gauss-Legendre integration to relative tolerance TOLER\n\
+  -x        closed-form Stroh (sextic) solution; no theta integration\n\
+  -c        cross-check the Stroh solution against the integrals\n\
+  -H        cubic Hermite interpolation in theta (use with fewer STEPS)\n\
+  -C CACHEDIR keep the theta tables in CACHEDIR, and reuse them\n\
+  -j NTHREADS read and displace the atoms with NTHREADS threads\n\
+  -b        write a binary slab, rather than XYZ (not with -v)\n\
+  -i ITERTOL iterate to self-consistency in memory, until no atom moves\n\
+            more than ITERTOL\n\
+  -n MAXITER maximum number of iterations for -i (default 100); if -i\n\
+            doesn't converge in that many, exit status is 1\n\
+  -m HISTORY Anderson mixing history for -i (default 5; 0 = none)\n\
   -v        verbosity\n\
   -t        testing\n\
   -h        help";
@@ -314,13 +352,63 @@ int main ( int argc, char **argv )
   int TESTING = 0;  // Extreme verbosity (testing purposes)
   int ERROR = 0;    // Analysis: Error flag (for analysis purposes)
   int Nsteps = 16384; // 2^14, default
+  int Ngauss = 0;     // Gauss points per panel; 0 = Simpson stepper
+  int Npanels = 0;    // 0: default for the integration method
+  double toler = 0.;  // adaptive integration tolerance; 0 = fixed panels
+  int STROH = 0;      // STROH_SOLVE: closed-form; STROH_CHECK: compare
+  char* cachedir = NULL; // where to keep the theta tables
+  int Nthreads = 1;   // for the per-atom work
+  int HERMITE = 0;    // cubic Hermite interpolation of u_xyz(theta)
+  int BINARY = 0;     // write a binary slab
+  double itertol = 0.; // self-consistency tolerance; 0 = one pass
+  int maxiter = 100;
+  int NOTCONVERGED = 0; // -i ran out of iterations
+  int Nhistory = 5;    // Anderson mixing history for -i
 
   char ch;
-  while ((ch = getopt(argc, argv, "vths:")) != -1) {
+  while ((ch = getopt(argc, argv, "vths:g:p:e:xcHC:i:n:m:j:b")) != -1) {
     switch (ch) {
     case 's':
       Nsteps = (int)strtol(optarg, (char**)NULL, 10);
       break;
+    case 'g':
+      Ngauss = (int)strtol(optarg, (char**)NULL, 10);
+      break;
+    case 'p':
+      Npanels = (int)strtol(optarg, (char**)NULL, 10);
+      break;
+    case 'e':
+      toler = strtod(optarg, (char**)NULL);
+      break;
+    case 'x':
+      STROH = STROH_SOLVE;
+      break;
+    case 'c':
+      STROH = STROH_CHECK;
+      break;
+    case 'H':
+      HERMITE = 1;
+      break;
+    case 'C':
+      cachedir = optarg;
+      break;
+    case 'j':
+      Nthreads = (int)strtol(optarg, (char**)NULL, 10);
+      if (Nthreads < 1) Nthreads = 1;
+      break;
+    case 'b':
+      BINARY = 1;
+      break;
+    case 'i':
+      itertol = strtod(optarg, (char**)NULL);
+      break;
+    case 'n':
+      maxiter = (int)strtol(optarg, (char**)NULL, 10);
+      break;
+    case 'm':
+      Nhistory = (int)strtol(optarg, (char**)NULL, 10);
+      if (Nhistory < 0) Nhistory = 0;
+      break;
     case 'v':
       VERBOSE = 1;
       break;
@@ -338,8 +426,20 @@ int main ( int argc, char **argv )
   argc -= optind; if (argc<NUMARGS && !ERROR) ERROR = 2;
   argv += optind;
 
+  // argument compatibility check: verbose output goes to stdout too
+  if (BINARY && VERBOSE) ERROR = 1;
+
+  if (HERMITE && (Ngauss <= 0) && (toler <= 0.)) Ngauss = ADAPT_NGAUSS;
+  if (toler > 0.) {
+    if (Ngauss <= 0) Ngauss = ADAPT_NGAUSS;
+    if (Npanels == 0) Npanels = ADAPT_NPANELS;
+  }
+  if (Npanels == 0) Npanels = DEFAULT_NPANELS;
+
   if (TESTING) {
     printf("# Nsteps=%d\n", Nsteps);
+    if (Ngauss > 0) printf("# Ngauss=%d Npanels=%d\n", Ngauss, Npanels);
+    if (toler > 0.) printf("# toler=%.3le\n", toler);
   }
   // We're going to use the number of steps according to our preferred
   // amount of memory allocation.
@@ -347,6 +447,11 @@ int main ( int argc, char **argv )
     fprintf(stderr, "Nsteps (%d) must be 4 or larger.\n", Nsteps);
     ERROR = 2;
   }  
+  if ( (Ngauss > 0) && ((Npanels < 1) || (Nsteps % Npanels != 0)) ) {
+    fprintf(stderr, "Npanels (%d) must be positive and divide Nsteps (%d).\n",
+	    Npanels, Nsteps);
+    ERROR = 2;
+  }
 
   // All hell broken loose yet?
   if (ERROR != 0) {
@@ -394,7 +499,7 @@ int main ( int argc, char **argv )
   }
   {
     int Natoms=NO_ATOMS;
-    double **u_atoms=NULL;
+    atom_list u_atoms;
     ERROR = read_cell(infile, cart, crystal, Cmn_list, u_atoms, Natoms);
   }
   myclose(infile);
@@ -408,7 +513,7 @@ int main ( int argc, char **argv )
   }
 
   if (TESTING)
-    verbose_output_cell(cart, crystal, Cmn_list, NULL, 0);
+    verbose_output_cell(cart, crystal, Cmn_list, NULL);
 
   // Now, read in the dislocation information
   infile = myopenr(infile_name);
@@ -524,134 +629,130 @@ int main ( int argc, char **argv )
   double dtheta;
   dtheta = M_PI / Nsteps;
   double mt[3], nt[3];
-  double nnt[9], mmt[9], nmt[9], mnt[9], nnti[9];
-  double detnn;
-
-  // We have to integrate three functions.
-  double **Nint, **Lint;
-  double Bint[9];
-
-  Nint = new double*[Nsteps+1];
-  Lint = new double*[Nsteps+1];
-  for (i=0; i<=Nsteps; ++i) {
-    Nint[i] = new double[9];
-    Lint[i] = new double[9];
-  }
-  
-  // Function evaluations, stored for integration purposes.
-  double nn_old[4][9], nnnm_old[4][9], mnnnnm_old[4][9];
-
-  // First, prime the integration pump:
-  for (k=1; k<=3; ++k) {
-    theta = -(k-1)*dtheta;
-    // Eval (nn), (nm), (mn), (mm), and (nn)^-1
-    m_theta(theta, m0, n0, mt);
-    n_theta(theta, m0, n0, nt);
-    a_mult_a(mt, Cijkl, mmt);
-    a_mult_a(nt, Cijkl, nnt);
-    a_mult_b(nt, mt, Cijkl, nmt);
-    transpose(nmt, mnt);
-    detnn = 1./inverse(nnt, nnti);
-    for (i=0; i<9; ++i) nnti[i] *= detnn;
-    // Now, put into the function evaluations:
-    for (i=0; i<9; ++i) nn_old[k][i] = nnti[i];
-    mult(nnti, nmt, nnnm_old[k]);
-    mult(mnt, nnnm_old[k], mnnnnm_old[k]);
-    for (i=0; i<9; ++i)
-      mnnnnm_old[k][i] = mmt[i] - mnnnnm_old[k][i];
-    // And HERE's where we'd integrate, if we wanted to... :)
-  }
-
-  // Now we've got EVERYTHING, let's integrate!
-  // theta = 0 is easy...
-  for (i=0; i<9; ++i) {
-    Nint[0][i] = 0.;
-    Lint[0][i] = 0.;
-    Bint[i] = 0.;
-  }
 
-  for (k=1; k<=Nsteps; ++k) {
-    theta = k*dtheta;
-    // Eval (nn), (nm), (mn), (mm), and (nn)^-1
-    m_theta(theta, m0, n0, mt);
-    n_theta(theta, m0, n0, nt);
-    a_mult_a(mt, Cijkl, mmt);
-    a_mult_a(nt, Cijkl, nnt);
-    a_mult_b(nt, mt, Cijkl, nmt);
-    transpose(nmt, mnt);
-    detnn = 1./inverse(nnt, nnti);
-    for (i=0; i<9; ++i) nnti[i] *= detnn;
-
-    // Now, put into the function evaluations:
-    for (i=0; i<9; ++i) nn_old[0][i] = nnti[i];
-    mult(nnti, nmt, nnnm_old[0]);
-    mult(mnt, nnnm_old[0], mnnnnm_old[0]);
-    for (i=0; i<9; ++i)
-      mnnnnm_old[0][i] = mmt[i] - mnnnnm_old[0][i];
-    // Now, we can integrate!
-    for (i=0; i<9; ++i) {
-      Nint[k][i] = Nint[k-1][i];
-      Lint[k][i] = Lint[k-1][i];
-      for (j=0; j<4; ++j) {
-	Nint[k][i] += dtheta*int_weight[j]*nn_old[j][i];
-	Lint[k][i] += dtheta*int_weight[j]*nnnm_old[j][i];
-	Bint[i]    += dtheta*int_weight[j]*mnnnnm_old[j][i];
-      }
+  // We have to integrate three functions...
+  double **Nint=NULL, **Lint=NULL;
+  double Sint[9], Bint[9];
+  int Neval;
+  // ...unless we use the closed-form solution:
+  stroh_solution stroh;
+  cplx stroh_c[3][3];
+
+  if (STROH) {
+    if (stroh_solve(Cijkl, m0, n0, stroh) != 0) {
+      fprintf(stderr, "Degenerate Stroh roots; integrating instead.\n");
+      STROH = 0;
     }
-    // Now, we slide down all of our "old" values:
-    for (j=3; j>0; --j)
+    else
+      stroh_coeff(stroh, b0, m0, n0, t0, stroh_c);
+  }
+  int TABLES = (STROH != STROH_SOLVE);  // do we need the theta tables?
+  int method = (toler > 0.) ? INTEGRATE_ADAPTIVE :
+    (Ngauss > 0) ? INTEGRATE_GAUSS : INTEGRATE_SIMPSON;
+
+  // ...or if a previous run already did the work:
+  table_key key;
+  table_cache cache;
+  char cachename[1024];
+  int CACHED = 0;
+  cache.map = NULL;
+  if (TABLES && (cachedir != NULL)) {
+    table_key_make(key, Cijkl, m0, n0, t0, b0,
+		   method, Nsteps, Npanels, Ngauss, toler);
+    table_cache_name(cachedir, key, cachename, sizeof(cachename));
+    CACHED = (table_cache_read(cachename, key, cache) == 0);
+    if (CACHED) {
       for (i=0; i<9; ++i) {
-	nn_old[j][i] = nn_old[j-1][i];
-	nnnm_old[j][i] = nnnm_old[j-1][i];
-	mnnnnm_old[j][i] = mnnnnm_old[j-1][i];
+	Sint[i] = cache.Sint[i];
+	Bint[i] = cache.Bint[i];
       }
-    // And do it all again!
+      if (VERBOSE) printf("# theta tables from %s\n", cachename);
+    }
   }
-  // Finally, define S, and scale everything appropriately.
-  double Sint[9];
-
-  for (k=0; k<=Nsteps; ++k)
-    for (i=0; i<9; ++i) 
-      Nint[k][i] *= (4.*M_PI);
-  
-  for (i=0; i<9; ++i) {
-    Sint[i] = -Lint[Nsteps][i] * M_1_PI;
-    Bint[i] *= 0.25*M_1_PI*M_1_PI;
-  }      
 
-  // Displacement!
-  double** u;
-  double NB[9], LS[9], sum[9];
+  // The theta tables all go in one block (arena.H):
+  arena tables;
+  if (init_arena(tables, TABLES ? theta_tables_len(Nsteps) : 0) != 0) {
+    fprintf(stderr, "Not enough memory for the theta tables.\n");
+    exit(ERROR_MEMORY);
+  }
+  if (TABLES && !CACHED) {
+    Nint = arena_table(tables, Nsteps+1, 9);
+    Lint = arena_table(tables, Nsteps+1, 9);
+    if ( (Nint == NULL) || (Lint == NULL) ) {
+      fprintf(stderr, "Not enough memory for the theta tables.\n");
+      exit(ERROR_MEMORY);
+    }
 
-  u = new double*[Nsteps+1];
-  for (k=0; k<=Nsteps; ++k) {
-    u[k] = new double[3];
-    theta = k*dtheta;
-    // Eval. the theta part of u_i:
-    mult(Nint[k], Bint, NB);
-    mult(Lint[k], Sint, LS);
-    for (i=0; i<9; ++i) sum[i] = NB[i] + LS[i];
-    mult_vect(sum, b0, u[k]);
-    for (i=0; i<3; ++i) u[k][i] *= 0.5*M_1_PI;
+    Neval = integrate_angular(Cijkl, m0, n0, method,
+			      Nsteps, Npanels, Ngauss, toler,
+			      Nint, Lint, Sint, Bint);
+    if (TESTING) printf("# %d kernel evaluations\n", Neval);
+    if (toler > 0.)
+      fprintf(stderr, "# adaptive integration: %d panels of %d points, %d kernel evaluations\n",
+	      Npanels, Ngauss, Neval);
   }
+  else if (!TABLES)
+    stroh_SB(stroh, Sint, Bint);
 
-  // Now, let's put those displacements into cylindrical coordinates:
-  double** u_xyz;
+  // Displacement!
+  double** u=NULL;
+  double** u_xyz=NULL;
+  double NB[9], LS[9], sum[9];
   double tmagn;
   tmagn = 1./sqrt(dot(t0,t0));
-  u_xyz = new double*[2*Nsteps+1];
-  for (k=0; k<=Nsteps; ++k) {
-    u_xyz[k] = new double[3];
-    u_xyz[k][0] = dot(u[k], m0);
-    u_xyz[k][1] = dot(u[k], n0);
-    u_xyz[k][2] = dot(u[k], t0) * tmagn;
+
+  if (TABLES && !CACHED) {
+    u = arena_table(tables, Nsteps+1, 3);
+    if (u == NULL) {
+      fprintf(stderr, "Not enough memory for the theta tables.\n");
+      exit(ERROR_MEMORY);
+    }
+    for (k=0; k<=Nsteps; ++k) {
+      theta = k*dtheta;
+      // Eval. the theta part of u_i:
+      mult(Nint[k], Bint, NB);
+      mult(Lint[k], Sint, LS);
+      for (i=0; i<9; ++i) sum[i] = NB[i] + LS[i];
+      mult_vect(sum, b0, u[k]);
+      for (i=0; i<3; ++i) u[k][i] *= 0.5*M_1_PI;
+    }
+
+    // Now, let's put those displacements into cylindrical coordinates:
+    u_xyz = arena_table(tables, 2*Nsteps+1, 3);
+    if (u_xyz == NULL) {
+      fprintf(stderr, "Not enough memory for the theta tables.\n");
+      exit(ERROR_MEMORY);
+    }
+    for (k=0; k<=Nsteps; ++k) {
+      u_xyz[k][0] = dot(u[k], m0);
+      u_xyz[k][1] = dot(u[k], n0);
+      u_xyz[k][2] = dot(u[k], t0) * tmagn;
+    }
+    for ( ; k<=(2*Nsteps); ++k) {
+      u_xyz[k][0] = dot(u[k-Nsteps], m0) + u_xyz[Nsteps][0];
+      u_xyz[k][1] = dot(u[k-Nsteps], n0) + u_xyz[Nsteps][1];
+      u_xyz[k][2] = dot(u[k-Nsteps], t0) * tmagn + u_xyz[Nsteps][2];
+    }
   }
-  for ( ; k<=(2*Nsteps); ++k) {
-    u_xyz[k] = new double[3];
-    u_xyz[k][0] = dot(u[k-Nsteps], m0) + u_xyz[Nsteps][0];
-    u_xyz[k][1] = dot(u[k-Nsteps], n0) + u_xyz[Nsteps][1];
-    u_xyz[k][2] = dot(u[k-Nsteps], t0) * tmagn + u_xyz[Nsteps][2];
+  if (CACHED) {
+    u_xyz = new double*[2*Nsteps+1];
+    for (k=0; k<=(2*Nsteps); ++k)
+      u_xyz[k] = cache.u_xyz + 3*k;
   }
+  else if (TABLES && (cachedir != NULL))
+    if (table_cache_write(cachename, key, Sint, Bint, u_xyz) != 0)
+      fprintf(stderr, "Could not write the theta tables to %s\n", cachename);
+  double** du_xyz=NULL;
+  if (TABLES && HERMITE) {
+    du_xyz = hermite_table(tables, Cijkl, m0, n0, t0, b0, Sint, Bint, Nsteps);
+    if (du_xyz == NULL) {
+      fprintf(stderr, "Not enough memory for the theta tables.\n");
+      exit(ERROR_MEMORY);
+    }
+  }
+  if (STROH == STROH_CHECK)
+    stroh_crosscheck(stroh, stroh_c, Sint, Bint, Nsteps, u_xyz, stderr);
 
   
   // ****************************** OUTPUT ***************************
@@ -676,29 +777,35 @@ int main ( int argc, char **argv )
 	     dot(u0, tnorm), dot(u0, m0), dot(u0, n0));
       printf("# \n");
       
-      // Now, let's output it; next, just the angular part.
-      printf("# theta  u.t  u.m(theta)  u.n(theta)\n");
-      // 0..Pi
-      for (k=0; k<=Nsteps; ++k) {
-	theta = k*dtheta;
-	// For output in "dislocation coordinates":
-	m_theta(theta, m0, n0, mt);
-	n_theta(theta, m0, n0, nt);
-	printf("%10.7lf %.15lf %.15lf %.15lf\n", theta,
-	       dot(u[k], tnorm), dot(u[k], mt), dot(u[k], nt));
-      }
-      // Pi .. 2Pi
-      // We handle this simply adding in the u0 = u[Nsteps]
-      for (i=0; i<3; ++i) u0[i] = u[Nsteps][i];
-      for (k=1; k<=Nsteps; ++k) {
-	theta = k*dtheta + M_PI;
-	// For output in "dislocation coordinates":
-	m_theta(theta, m0, n0, mt);
-	n_theta(theta, m0, n0, nt);
-	printf("%10.7lf %.15lf %.15lf %.15lf\n", theta,
-	       dot(u[k], tnorm)+dot(u0,tnorm), 
-	       dot(u[k], mt)+dot(u0,mt),
-	       dot(u[k], nt)+dot(u0,nt));
+      if (!TABLES)
+	printf("# (Stroh solution; no theta tables to output)\n");
+      else if (CACHED)
+	printf("# (cached theta tables; no u(theta) to output)\n");
+      else {
+	// Now, let's output it; next, just the angular part.
+	printf("# theta  u.t  u.m(theta)  u.n(theta)\n");
+	// 0..Pi
+	for (k=0; k<=Nsteps; ++k) {
+	  theta = k*dtheta;
+	  // For output in "dislocation coordinates":
+	  m_theta(theta, m0, n0, mt);
+	  n_theta(theta, m0, n0, nt);
+	  printf("%10.7lf %.15lf %.15lf %.15lf\n", theta,
+	         dot(u[k], tnorm), dot(u[k], mt), dot(u[k], nt));
+	}
+	// Pi .. 2Pi
+	// We handle this simply adding in the u0 = u[Nsteps]
+	for (i=0; i<3; ++i) u0[i] = u[Nsteps][i];
+	for (k=1; k<=Nsteps; ++k) {
+	  theta = k*dtheta + M_PI;
+	  // For output in "dislocation coordinates":
+	  m_theta(theta, m0, n0, mt);
+	  n_theta(theta, m0, n0, nt);
+	  printf("%10.7lf %.15lf %.15lf %.15lf\n", theta,
+	         dot(u[k], tnorm)+dot(u0,tnorm), 
+	         dot(u[k], mt)+dot(u0,mt),
+	         dot(u[k], nt)+dot(u0,nt));
+	}
       }
     }
   }
@@ -715,82 +822,117 @@ int main ( int argc, char **argv )
     xyz0[1] = dot(u0, n0);
     xyz0[2] = dot(u0, t0)*tmagn;
     // Our scaling factor:
-    double aln;
+    disloc_field field;
     // double a0;
     // a0 = exp( log(det(cart)/Natoms) / 3.);
     // aln = -log(a0);
-    aln = - log(det(cart)) / 3.;
+    field.aln = - log(det(cart)) / 3.;
+    for (i=0; i<3; ++i) field.xyz0[i] = xyz0[i];
     // for interpolation purposes:
-    double inv_dtheta = 1./dtheta;
+    field.Nsteps = Nsteps;
+    field.inv_dtheta = 1./dtheta;
+    field.u_xyz = u_xyz;  // NULL for the closed form
+    field.du_xyz = du_xyz;  // NULL for linear interpolation
+    field.p = stroh.p;
+    field.c = stroh_c;
 
     // Output XYZ files!!
     infile = myopenr(undisloc_name);
     infile_ref = myopenr(reference_name);
-    int Nslab;
-    // Natoms
-    nextnoncomment(dump, sizeof(dump), infile);
-    printf(dump);
-    sscanf(dump, "%d", &Nslab);
-    nextnoncomment(dump, sizeof(dump), infile_ref); // dummy readline
-    // comment
-    nextnoncomment(dump, sizeof(dump), infile);
-    printf(dump);
-    nextnoncomment(dump, sizeof(dump), infile_ref); // dummy readline
-    for (int n=0; n<Nslab; ++n) {
-      char atomname[512];
-      double xyz[3];
-      double xyz_ref[3];
-      // undislocated atom x y z
-      nextnoncomment(dump, sizeof(dump), infile);
-      sscanf(dump, "%s %lf %lf %lf", atomname, xyz, xyz+1, xyz+2);
-      // reference atom x y z
-      nextnoncomment(dump, sizeof(dump), infile_ref);
-      sscanf(dump, "%*s %lf %lf %lf", xyz_ref, xyz_ref+1, xyz_ref+2);
-
-      // Now, we need to do some analysis on our displacements; first,
-      // we need to calculate the distance from the dislocation,
-      // and the magical angle theta for each:
-      double dist_ref = sqrt( xyz_ref[0]*xyz_ref[0] + xyz_ref[1]*xyz_ref[1]);
-      ERROR = dcomp(dist_ref, 0.);
-      double theta_ref = atan2(xyz_ref[1], xyz_ref[0]);
-      if (theta_ref < 0.) theta_ref += (2.*M_PI);
-      if (ERROR) {
-	    fprintf(stderr, "You managed to center your dislocation right on an atom... that's not so good.\n");
-	    break;
+    // In memory: the undislocated and reference slabs.
+    slab_file slab, ref;
+    ERROR = read_slab(infile, slab, Nthreads);
+    if (ERROR) slab_error(undisloc_name, slab);
+    int ERROR_REF = read_slab(infile_ref, ref, Nthreads);
+    if (ERROR_REF) slab_error(reference_name, ref);
+    else if (!ERROR && (slab.Nslab != ref.Nslab)) {
+      fprintf(stderr, "%s and %s don't have the same number of atoms.\n",
+	      undisloc_name, reference_name);
+      ERROR_REF = ERROR_BADXYZ;
+    }
+    if (ERROR || ERROR_REF) {
+      free_slab_file(slab);
+      free_slab_file(ref);
+      myclose(infile);
+      myclose(infile_ref);
+      exit(1);
+    }
+    int Nslab = slab.Nslab;
+    // positions out, as x[], y[], z[]:
+    double* xo = new double[3*Nslab];
+    double *yo = xo + Nslab, *zo = yo + Nslab;
+    if (!ERROR && (itertol > 0.)) {
+      // Self-consistent.
+      // x: reference positions, gx: R_undisloc + u(x)
+      double* x = new double[3*Nslab];
+      double* gx = new double[3*Nslab];
+      for (int n=0; n<Nslab; ++n) {
+	x[3*n] = ref.x[n];
+	x[3*n+1] = ref.y[n];
+	x[3*n+2] = ref.z[n];
       }
-      
-      // Let's displace all of the atoms accordingly:
-      // xyz0*(ln|x| - ln(a0)) + u_xyz(theta)
-      double lnr = log(dist_ref) + aln;
-      // Now, linearly interpolate for theta:
-      double kreal = theta_ref * inv_dtheta;
-      int k = (int) kreal;
-      double alpha = kreal - k, beta = 1. - alpha;
-      for (int d=0; d<3; ++d) {
-	    xyz[d] += xyz0[d]*lnr + beta*u_xyz[k][d] + alpha*u_xyz[k+1][d];
+      anderson_mix mix;
+      anderson_init(mix, 3*Nslab, Nhistory);
+      int iter, converged = 0;
+      for (iter=1; (iter<=maxiter) && !ERROR && !converged; ++iter) {
+	double maxchange;
+	ERROR = displace_sweep(field, Nslab, slab.x, slab.y, slab.z,
+			       x, gx, Nthreads, maxchange);
+	if (ERROR) {
+	  fprintf(stderr, "You managed to center your dislocation right on an atom... that's not so good.\n");
+	  break;
+	}
+	fprintf(stderr, "# iteration %3d: max change %.6le\n", iter, maxchange);
+	converged = (maxchange < itertol);
+	if (converged || (Nhistory == 0))
+	  for (int i=0; i<3*Nslab; ++i) x[i] = gx[i];
+	else
+	  anderson_step(mix, x, gx, 0.5);
       }
-      // output
-      printf("%s %20.15lf %20.15lf %20.15lf\n", atomname, xyz[0], xyz[1], xyz[2]);
+      if (!ERROR) {
+	if (!converged) {
+	  fprintf(stderr, "Not converged to %.3le after %d iterations.\n",
+		  itertol, maxiter);
+	  NOTCONVERGED = 1;
+	}
+	else if (mix.Nrestart > 0)
+	  fprintf(stderr, "# (Anderson history restarted %d times)\n",
+		  mix.Nrestart);
+	for (int n=0; n<Nslab; ++n) {
+	  xo[n] = x[3*n];
+	  yo[n] = x[3*n+1];
+	  zo[n] = x[3*n+2];
+	}
+      }
+      anderson_free(mix);
+      delete[] x;
+      delete[] gx;
+    }
+    else if (!ERROR) {
+      // One pass: R_undisloc + u(R_reference)
+      ERROR = displace_slab(field, Nslab, slab.x, slab.y, slab.z,
+			    ref.x, ref.y, xo, yo, zo, Nthreads);
+      if (ERROR)
+	fprintf(stderr, "You managed to center your dislocation right on an atom... that's not so good.\n");
     }
+    if (!ERROR)
+      if (write_slab(stdout, BINARY, slab, xo, yo, zo, Nthreads) != 0)
+	fprintf(stderr, "Couldn't write the slab.\n");
+    delete[] xo;
+    free_slab_file(slab);
+    free_slab_file(ref);
     myclose(infile);
     myclose(infile_ref);
   }
 
   // ************************* GARBAGE COLLECTION ********************
-  for (i=0; i<=(2*Nsteps); ++i)
-    delete[] u_xyz[i];
-  delete[] u_xyz;
-
-  for (i=0; i<=Nsteps; ++i) {
-    delete[] Nint[i];
-    delete[] Lint[i];
-    delete[] u[i];
+  if (CACHED) {
+    delete[] u_xyz;
+    table_cache_close(cache);
   }
-  delete[] u;
-  delete[] Nint;
-  delete[] Lint;
+  free_arena(tables);
 
   delete[] Cmn_list;
 
-  return 0;
+  return NOTCONVERGED;
 }
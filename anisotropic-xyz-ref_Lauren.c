@@ -46,6 +46,7 @@
 	       undisloc:  undislocated crystal input XYZ file
            reference: input XYZ file to be used as reference for evaluating
                       the displacement field (undislocated/dislocated crystal)
+	   (undisloc and reference may also be binary slabs; see slabfile.H)
 
 	   ==== cell ====
        a0                               # Scale factor for unit cell
@@ -156,6 +157,19 @@
 	   We do 16384 integration steps (2^14... woohoo!) to make
 	   sure that we have something reasonable :)
 
+	   Alternatively (-g NGAUSS), we do composite Gauss-Legendre
+	   integration: NPANELS panels with NGAUSS points each.  The
+	   table entries inside a panel come from integrating the
+	   polynomial through the Gauss points; 32 panels of 8 points
+	   (256 evaluations) gets S and B to ~1e-13.  The integrals
+	   themselves live in angular.H.
+
+	   With -e TOLER, the Gauss panels are chosen adaptively instead:
+	   starting from 4 panels (or -p NPANELS), each is bisected until
+	   its two halves agree with it to relative error TOLER, so the
+	   work goes where (nn)^-1 changes quickly.  The number of panels
+	   and kernel evaluations actually used goes to stderr.
+
   Output:  If we're verbose, we'll output the theta dependence of u_i, and
            also the ln |x| prefactor.
 
@@ -183,6 +197,9 @@
 #include "elastic.H"
 #include "cell.H"
 #include "integrate.H"
+#include "angular.H"
+#include "slabfile.H"
+#include "format.H"
 
 // This is the permutation matrix; eps[i][j][k] =
 //  1: if ijk is an even permutation of (012)
@@ -202,48 +219,6 @@ inline double dot(double a[3], double b[3])
 }
 
 
-void m_theta(double theta, double m[3], double n[3], double mt[3])
-{
-  mt[0] = cos(theta)*m[0] + sin(theta)*n[0];
-  mt[1] = cos(theta)*m[1] + sin(theta)*n[1];
-  mt[2] = cos(theta)*m[2] + sin(theta)*n[2];
-}
-
-void n_theta(double theta, double m[3], double n[3], double nt[3])
-{
-  nt[0] = -sin(theta)*m[0] + cos(theta)*n[0];
-  nt[1] = -sin(theta)*m[1] + cos(theta)*n[1];
-  nt[2] = -sin(theta)*m[2] + cos(theta)*n[2];
-}
-
-void a_mult_b (double a[3], double b[3], double Cijkl[9][9],
-	       double ab[9])
-{
-  int i, j, k, l;
-  for (i=0; i<3; ++i)
-    for (j=0; j<3; ++j) {
-      ab[index(i,j)] = 0.;
-      for (k=0; k<3; ++k)
-	for (l=0; l<3; ++l)
-	  ab[index(i,j)] += a[k]*Cijkl[index(k,i)][index(j,l)]*b[l];
-    }
-}
-
-void a_mult_a (double a[3], double Cijkl[9][9], double aa[9])
-{
-  int i, j, k, l;
-  for (i=0; i<3; ++i) {
-    for (j=0; j<i; ++j)
-      aa[index(i,j)] = aa[index(j,i)];
-    for (   ; j<3; ++j) {
-      aa[index(i,j)] = 0.;
-      for (k=0; k<3; ++k)
-	for (l=0; l<3; ++l)
-	  aa[index(i,j)] += a[k]*Cijkl[index(k,i)][index(j,l)]*a[l];
-    }
-  }
-}
-
 void print_mat (double a[9])
 {
   int i, j;
@@ -259,7 +234,7 @@ void print_mat (double a[9])
 
 // Arguments first, then flags, then explanation.
 const int NUMARGS = 4;
-const char* ARGLIST = "[-hvt] [-s STEPS] cell infile undisloc reference";
+const char* ARGLIST = "[-hvt] [-s STEPS] [-g NGAUSS [-p NPANELS]] [-e TOLER] [-j NTHREADS] cell infile undisloc reference";
 
 const char* ARGEXPL =
 " cell:      cell file (-h for format)\n\
@@ -268,6 +243,10 @@ const char* ARGEXPL =
   reference: reference crystal input XYZ file\n\
 \n\
   -s STEPS  number of integration steps\n\
+  -g NGAUSS  Gauss-Legendre integration, NGAUSS points per panel\n\
+  -p NPANELS number of Gauss panels (default 32; must divide STEPS)\n\
+  -e TOLER  adaptive Gauss-Legendre integration to relative tolerance TOLER\n\
+  -j NTHREADS read undisloc with NTHREADS threads\n\
   -v        verbosity\n\
   -t        testing\n\
   -h        help";
@@ -315,13 +294,30 @@ int main ( int argc, char **argv )
   int TESTING = 0;  // Extreme verbosity (testing purposes)
   int ERROR = 0;    // Analysis: Error flag (for analysis purposes)
   int Nsteps = 16384; // 2^14, default
+  int Ngauss = 0;     // Gauss points per panel; 0 = Simpson stepper
+  int Npanels = 0;    // 0: default for the integration method
+  double toler = 0.;  // adaptive integration tolerance; 0 = fixed panels
+  int Nthreads = 1;   // for reading undisloc
 
   char ch;
-  while ((ch = getopt(argc, argv, "vths:")) != -1) {
+  while ((ch = getopt(argc, argv, "vths:g:p:e:j:")) != -1) {
     switch (ch) {
     case 's':
       Nsteps = (int)strtol(optarg, (char**)NULL, 10);
       break;
+    case 'g':
+      Ngauss = (int)strtol(optarg, (char**)NULL, 10);
+      break;
+    case 'p':
+      Npanels = (int)strtol(optarg, (char**)NULL, 10);
+      break;
+    case 'e':
+      toler = strtod(optarg, (char**)NULL);
+      break;
+    case 'j':
+      Nthreads = (int)strtol(optarg, (char**)NULL, 10);
+      if (Nthreads < 1) Nthreads = 1;
+      break;
     case 'v':
       VERBOSE = 1;
       break;
@@ -339,8 +335,16 @@ int main ( int argc, char **argv )
   argc -= optind; if (argc<NUMARGS && !ERROR) ERROR = 2;
   argv += optind;
 
+  if (toler > 0.) {
+    if (Ngauss <= 0) Ngauss = ADAPT_NGAUSS;
+    if (Npanels == 0) Npanels = ADAPT_NPANELS;
+  }
+  if (Npanels == 0) Npanels = DEFAULT_NPANELS;
+
   if (TESTING) {
     printf("# Nsteps=%d\n", Nsteps);
+    if (Ngauss > 0) printf("# Ngauss=%d Npanels=%d\n", Ngauss, Npanels);
+    if (toler > 0.) printf("# toler=%.3le\n", toler);
   }
   // We're going to use the number of steps according to our preferred
   // amount of memory allocation.
@@ -348,6 +352,11 @@ int main ( int argc, char **argv )
     fprintf(stderr, "Nsteps (%d) must be 4 or larger.\n", Nsteps);
     ERROR = 2;
   }
+  if ( (Ngauss > 0) && ((Npanels < 1) || (Nsteps % Npanels != 0)) ) {
+    fprintf(stderr, "Npanels (%d) must be positive and divide Nsteps (%d).\n",
+	    Npanels, Nsteps);
+    ERROR = 2;
+  }
 
   // All hell broken loose yet?
   if (ERROR != 0) {
@@ -395,7 +404,7 @@ int main ( int argc, char **argv )
   }
   {
     int Natoms=NO_ATOMS;
-    double **u_atoms=NULL;
+    atom_list u_atoms;
     ERROR = read_cell(infile, cart, crystal, Cmn_list, u_atoms, Natoms);
   }
   myclose(infile);
@@ -409,7 +418,7 @@ int main ( int argc, char **argv )
   }
 
   if (TESTING)
-    verbose_output_cell(cart, crystal, Cmn_list, NULL, 0);
+    verbose_output_cell(cart, crystal, Cmn_list, NULL);
 
   // Now, read in the dislocation information
   infile = myopenr(infile_name);
@@ -525,108 +534,45 @@ int main ( int argc, char **argv )
   double dtheta;
   dtheta = M_PI / Nsteps;
   double mt[3], nt[3];
-  double nnt[9], mmt[9], nmt[9], mnt[9], nnti[9];
-  double detnn;
 
   // We have to integrate three functions.
   double **Nint, **Lint;
-  double Bint[9];
-
-  Nint = new double*[Nsteps+1];
-  Lint = new double*[Nsteps+1];
-  for (i=0; i<=Nsteps; ++i) {
-    Nint[i] = new double[9];
-    Lint[i] = new double[9];
+  double Sint[9], Bint[9];
+  int Neval;
+
+  // The theta tables all go in one block (arena.H):
+  arena tables;
+  if (init_arena(tables, theta_tables_len(Nsteps)) != 0) {
+    fprintf(stderr, "Not enough memory for the theta tables.\n");
+    exit(ERROR_MEMORY);
   }
-
-  // Function evaluations, stored for integration purposes.
-  double nn_old[4][9], nnnm_old[4][9], mnnnnm_old[4][9];
-
-  // First, prime the integration pump:
-  for (k=1; k<=3; ++k) {
-    theta = -(k-1)*dtheta;
-    // Eval (nn), (nm), (mn), (mm), and (nn)^-1
-    m_theta(theta, m0, n0, mt);
-    n_theta(theta, m0, n0, nt);
-    a_mult_a(mt, Cijkl, mmt);
-    a_mult_a(nt, Cijkl, nnt);
-    a_mult_b(nt, mt, Cijkl, nmt);
-    transpose(nmt, mnt);
-    detnn = 1./inverse(nnt, nnti);
-    for (i=0; i<9; ++i) nnti[i] *= detnn;
-    // Now, put into the function evaluations:
-    for (i=0; i<9; ++i) nn_old[k][i] = nnti[i];
-    mult(nnti, nmt, nnnm_old[k]);
-    mult(mnt, nnnm_old[k], mnnnnm_old[k]);
-    for (i=0; i<9; ++i)
-      mnnnnm_old[k][i] = mmt[i] - mnnnnm_old[k][i];
-    // And HERE's where we'd integrate, if we wanted to... :)
-  }
-
-  // Now we've got EVERYTHING, let's integrate!
-  // theta = 0 is easy...
-  for (i=0; i<9; ++i) {
-    Nint[0][i] = 0.;
-    Lint[0][i] = 0.;
-    Bint[i] = 0.;
-  }
-
-  for (k=1; k<=Nsteps; ++k) {
-    theta = k*dtheta;
-    // Eval (nn), (nm), (mn), (mm), and (nn)^-1
-    m_theta(theta, m0, n0, mt);
-    n_theta(theta, m0, n0, nt);
-    a_mult_a(mt, Cijkl, mmt);
-    a_mult_a(nt, Cijkl, nnt);
-    a_mult_b(nt, mt, Cijkl, nmt);
-    transpose(nmt, mnt);
-    detnn = 1./inverse(nnt, nnti);
-    for (i=0; i<9; ++i) nnti[i] *= detnn;
-
-    // Now, put into the function evaluations:
-    for (i=0; i<9; ++i) nn_old[0][i] = nnti[i];
-    mult(nnti, nmt, nnnm_old[0]);
-    mult(mnt, nnnm_old[0], mnnnnm_old[0]);
-    for (i=0; i<9; ++i)
-      mnnnnm_old[0][i] = mmt[i] - mnnnnm_old[0][i];
-    // Now, we can integrate!
-    for (i=0; i<9; ++i) {
-      Nint[k][i] = Nint[k-1][i];
-      Lint[k][i] = Lint[k-1][i];
-      for (j=0; j<4; ++j) {
-	Nint[k][i] += dtheta*int_weight[j]*nn_old[j][i];
-	Lint[k][i] += dtheta*int_weight[j]*nnnm_old[j][i];
-	Bint[i]    += dtheta*int_weight[j]*mnnnnm_old[j][i];
-      }
-    }
-    // Now, we slide down all of our "old" values:
-    for (j=3; j>0; --j)
-      for (i=0; i<9; ++i) {
-	nn_old[j][i] = nn_old[j-1][i];
-	nnnm_old[j][i] = nnnm_old[j-1][i];
-	mnnnnm_old[j][i] = mnnnnm_old[j-1][i];
-      }
-    // And do it all again!
+  Nint = arena_table(tables, Nsteps+1, 9);
+  Lint = arena_table(tables, Nsteps+1, 9);
+  if ( (Nint == NULL) || (Lint == NULL) ) {
+    fprintf(stderr, "Not enough memory for the theta tables.\n");
+    exit(ERROR_MEMORY);
   }
-  // Finally, define S, and scale everything appropriately.
-  double Sint[9];
 
-  for (k=0; k<=Nsteps; ++k)
-    for (i=0; i<9; ++i)
-      Nint[k][i] *= (4.*M_PI);
-
-  for (i=0; i<9; ++i) {
-    Sint[i] = -Lint[Nsteps][i] * M_1_PI;
-    Bint[i] *= 0.25*M_1_PI*M_1_PI;
-  }
+  Neval = integrate_angular(Cijkl, m0, n0,
+			    (toler > 0.) ? INTEGRATE_ADAPTIVE :
+			    (Ngauss > 0) ? INTEGRATE_GAUSS : INTEGRATE_SIMPSON,
+			    Nsteps, Npanels, Ngauss, toler,
+			    Nint, Lint, Sint, Bint);
+  if (TESTING) printf("# %d kernel evaluations\n", Neval);
+  if (toler > 0.)
+    fprintf(stderr, "# adaptive integration: %d panels of %d points, %d kernel evaluations\n",
+	    Npanels, Ngauss, Neval);
 
   // Displacement!
   double** u;
   double NB[9], LS[9], sum[9];
 
-  u = new double*[Nsteps+1];
+  u = arena_table(tables, Nsteps+1, 3);
+  if (u == NULL) {
+    fprintf(stderr, "Not enough memory for the theta tables.\n");
+    exit(ERROR_MEMORY);
+  }
   for (k=0; k<=Nsteps; ++k) {
-    u[k] = new double[3];
     theta = k*dtheta;
     // Eval. the theta part of u_i:
     mult(Nint[k], Bint, NB);
@@ -640,15 +586,17 @@ int main ( int argc, char **argv )
   double** u_xyz;
   double tmagn;
   tmagn = 1./sqrt(dot(t0,t0));
-  u_xyz = new double*[2*Nsteps+1];
+  u_xyz = arena_table(tables, 2*Nsteps+1, 3);
+  if (u_xyz == NULL) {
+    fprintf(stderr, "Not enough memory for the theta tables.\n");
+    exit(ERROR_MEMORY);
+  }
   for (k=0; k<=Nsteps; ++k) {
-    u_xyz[k] = new double[3];
     u_xyz[k][0] = dot(u[k], m0);
     u_xyz[k][1] = dot(u[k], n0);
     u_xyz[k][2] = dot(u[k], t0) * tmagn;
   }
   for ( ; k<=(2*Nsteps); ++k) {
-    u_xyz[k] = new double[3];
     u_xyz[k][0] = dot(u[k-Nsteps], m0) + u_xyz[Nsteps][0];
     u_xyz[k][1] = dot(u[k-Nsteps], n0) + u_xyz[Nsteps][1];
     u_xyz[k][2] = dot(u[k-Nsteps], t0) * tmagn + u_xyz[Nsteps][2];
@@ -727,27 +675,47 @@ int main ( int argc, char **argv )
     // Output XYZ files!!
     infile = myopenr(undisloc_name);
     infile_ref = myopenr(reference_name);
-    int Nslab;
+    // undisloc is read in whole (XYZ parsed with Nthreads threads, or
+    // a binary slab); the reference a line at a time, as it can carry
+    // a fourth column (theta from the last iteration):
+    slab_file undisloc;
+    ERROR = read_slab(infile, undisloc, Nthreads);
+    if (ERROR) {
+      slab_error(undisloc_name, undisloc);
+      free_slab_file(undisloc);
+      myclose(infile);
+      myclose(infile_ref);
+      exit(1);
+    }
+    slab_reader reference;
+    ERROR = open_slab_reader(reference, infile_ref);
+    if (ERROR) {
+      fprintf(stderr, "Couldn't read %s as a slab.\n", reference_name);
+      free_slab_file(undisloc);
+      close_slab_reader(reference);
+      myclose(infile);
+      myclose(infile_ref);
+      exit(1);
+    }
+    int Nslab = undisloc.Nslab;
     // Natoms
-    nextnoncomment(dump, sizeof(dump), infile);
-    printf(dump);
-    sscanf(dump, "%d", &Nslab);
-    nextnoncomment(dump, sizeof(dump), infile_ref); // dummy readline
+    fputs(undisloc.header[0], stdout);
+    slab_nextline(reference, dump, sizeof(dump)); // dummy readline
     // comment
-    nextnoncomment(dump, sizeof(dump), infile);
-    printf(dump);
-    nextnoncomment(dump, sizeof(dump), infile_ref); // dummy readline
+    fputs(undisloc.header[1], stdout);
+    slab_nextline(reference, dump, sizeof(dump)); // dummy readline
+    // the per-atom lines go through a big buffer (format.H):
+    outbuf out;
+    outbuf_open(out, stdout);
     for (int n=0; n<Nslab; ++n) {
-      char atomname[512];
-      double xyz[3];
       double xyz_ref[4];
       xyz_ref[3] = -100; //default value for first run
 
       // undislocated atom x y z
-      nextnoncomment(dump, sizeof(dump), infile);
-      sscanf(dump, "%s %lf %lf %lf", atomname, xyz, xyz+1, xyz+2);
+      const char* atomname = undisloc.species[undisloc.type[n]];
+      double xyz[3] = {undisloc.x[n], undisloc.y[n], undisloc.z[n]};
       // reference atom x y z
-      nextnoncomment(dump, sizeof(dump), infile_ref);
+      slab_nextline(reference, dump, sizeof(dump));
       sscanf(dump, "%*s %lf %lf %lf %lf", xyz_ref, xyz_ref+1, xyz_ref+2, xyz_ref+3);
       // Now, we need to do some analysis on our displacements; first,
       // we need to calculate the distance from the dislocation,
@@ -813,26 +781,25 @@ int main ( int argc, char **argv )
       }
 
       // output
-      printf("%s %20.15lf %20.15lf %20.15lf %20.15lf\n", atomname, xyz[0], xyz[1], xyz[2], xyz_ref[3]);
+      outbuf_str(out, atomname);
+      for (int d=0; d<3; ++d) {
+	outbuf_char(out, ' ');
+	outbuf_lf(out, xyz[d], 20, 15);
+      }
+      outbuf_char(out, ' ');
+      outbuf_lf(out, xyz_ref[3], 20, 15);
+      outbuf_char(out, '\n');
 
     }
+    outbuf_close(out);
+    free_slab_file(undisloc);
+    close_slab_reader(reference);
     myclose(infile);
     myclose(infile_ref);
   }
 
   // ************************* GARBAGE COLLECTION ********************
-  for (i=0; i<=(2*Nsteps); ++i)
-    delete[] u_xyz[i];
-  delete[] u_xyz;
-
-  for (i=0; i<=Nsteps; ++i) {
-    delete[] Nint[i];
-    delete[] Lint[i];
-    delete[] u[i];
-  }
-  delete[] u;
-  delete[] Nint;
-  delete[] Lint;
+  free_arena(tables);
 
   delete[] Cmn_list;
 
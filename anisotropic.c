@@ -129,6 +129,44 @@
 	   We do 16384 integration steps (2^14... woohoo!) to make
 	   sure that we have something reasonable :)
 
+	   Alternatively (-g NGAUSS), we do composite Gauss-Legendre
+	   integration: NPANELS panels with NGAUSS points each.  The
+	   table entries inside a panel come from integrating the
+	   polynomial through the Gauss points; 32 panels of 8 points
+	   (256 evaluations) gets S and B to ~1e-13.  The integrals
+	   themselves live in angular.H.
+
+	   With -e TOLER, the Gauss panels are chosen adaptively instead:
+	   starting from 4 panels (or -p NPANELS), each is bisected until
+	   its two halves agree with it to relative error TOLER, so the
+	   work goes where (nn)^-1 changes quickly.  The number of panels
+	   and kernel evaluations actually used goes to stderr.
+
+	   Or (-x), skip the integration entirely and use the closed-form
+	   Stroh (sextic) solution from stroh.H: one 6th order polynomial
+	   solve per dislocation, and u(x) is evaluated directly from the
+	   complex roots p_alpha, so there are no theta tables.  This
+	   falls back to integration when the p_alpha are degenerate.
+	   -c integrates as usual and reports the difference between the
+	   two on stderr.
+
+	   With -C CACHEDIR, the theta tables (S, B, and u_xyz) are
+	   written to CACHEDIR under a hash of Cijkl, the dislocation
+	   frame, b and the integration settings; later runs with the
+	   same inputs memory-map that file and skip the integration.
+	   See cache.H.
+
+	   With -S, the slab is never held in memory: the atoms are
+	   generated SLAB_BLOCK at a time (slab_next(), slab.H),
+	   displaced, and written, once for each output file, after a
+	   first pass that only counts them.  So memory doesn't grow
+	   with Rcut, and the files are the same as without -S.
+
+	   With -z (and not -S), the slab is put in Morton order
+	   (atoms.H) before it's displaced, so atoms that are close in
+	   space--and so in theta--are handled together; it goes back in
+	   lattice order to be written, so the files are the same.
+
   Output:  If we're verbose, we'll output the theta dependence of u_i, and
            also the ln |x| prefactor.
 
@@ -155,7 +193,11 @@
 #include "elastic.H"
 #include "cell.H"
 #include "integrate.H"
+#include "angular.H"
+#include "stroh.H"
+#include "cache.H"
 #include "slab.H"  // This is where we learn how to make a cylindrical slab.
+#include "format.H"
 
 // This is the permutation matrix; eps[i][j][k] =
 //  1: if ijk is an even permutation of (012)
@@ -175,48 +217,60 @@ inline double dot(double a[3], double b[3])
 }
 
 
-void m_theta(double theta, double m[3], double n[3], double mt[3]) 
+// The atom at xyz, displaced by xyz0*(ln|x| + aln) + u(theta); u from
+// the Stroh solution if u_xyz is NULL, else linearly interpolated.
+void displace_atom (double xyz[3], double xyz0[3], double aln,
+		    stroh_solution &stroh, cplx stroh_c[3][3],
+		    double** u_xyz, double inv_dtheta, double xyz_d[3])
 {
-  mt[0] = cos(theta)*m[0] + sin(theta)*n[0];
-  mt[1] = cos(theta)*m[1] + sin(theta)*n[1];
-  mt[2] = cos(theta)*m[2] + sin(theta)*n[2];
-}
-
-void n_theta(double theta, double m[3], double n[3], double nt[3]) 
-{
-  nt[0] = -sin(theta)*m[0] + cos(theta)*n[0];
-  nt[1] = -sin(theta)*m[1] + cos(theta)*n[1];
-  nt[2] = -sin(theta)*m[2] + cos(theta)*n[2];
+  int j, k;
+  double dist = sqrt( xyz[0]*xyz[0] + xyz[1]*xyz[1]);
+  double theta = atan2(xyz[1], xyz[0]) + M_PI/2.;
+  if (theta < 0.) theta += (2.*M_PI);
+  double lnr = log(dist) + aln;
+  if (u_xyz == NULL) {
+    // Closed form:
+    double du[3];
+    stroh_u_xyz(stroh.p, stroh_c, theta, du);
+    for (j=0; j<3; ++j)
+      xyz_d[j] = xyz[j] + xyz0[j]*lnr + du[j];
+    return;
+  }
+  // Now, linearly interpolate for theta:
+  double kreal = theta * inv_dtheta;
+  k = (int) kreal;
+  double alpha = kreal - k;
+  double beta = 1. - alpha;
+  for (j=0; j<3; ++j)
+    xyz_d[j] = xyz[j] + xyz0[j]*lnr
+      + beta*u_xyz[k][j] + alpha*u_xyz[k+1][j];
 }
 
-void a_mult_b (double a[3], double b[3], double Cijkl[9][9],
-	       double ab[9]) 
+// Write the header lines of an XYZ file for the slab.
+void slab_header (FILE* outfile, int Nslab, const char* what, double t0[3],
+		  int tu0[3], int bu0[3], int bu_denom, double Rcut)
 {
-  int i, j, k, l;
-  for (i=0; i<3; ++i)
-    for (j=0; j<3; ++j) {
-      ab[index(i,j)] = 0.;
-      for (k=0; k<3; ++k)
-	for (l=0; l<3; ++l)
-	  ab[index(i,j)] += a[k]*Cijkl[index(k,i)][index(j,l)]*b[l];
-    }
+  fprintf(outfile, "%d\n", Nslab);
+  fprintf(outfile, "%.15lf = z: %s slab, t = [%d %d %d], b = [%d %d %d]",
+	  sqrt(dot(t0,t0)), what,
+	  tu0[0], tu0[1], tu0[2],
+	  bu0[0], bu0[1], bu0[2]);
+  if (bu_denom != 1) fprintf(outfile, "/%d", bu_denom);
+  fprintf(outfile, " Rmax = %.3lf\n", Rcut);
 }
 
-void a_mult_a (double a[3], double Cijkl[9][9], double aa[9]) 
+// "%s %.15lf %.15lf %.15lf\n"
+inline void write_atom (outbuf &out, const char* atom_name, double xyz[3])
 {
-  int i, j, k, l;
-  for (i=0; i<3; ++i) {
-    for (j=0; j<i; ++j)
-      aa[index(i,j)] = aa[index(j,i)];
-    for (   ; j<3; ++j) {
-      aa[index(i,j)] = 0.;
-      for (k=0; k<3; ++k)
-	for (l=0; l<3; ++l)
-	  aa[index(i,j)] += a[k]*Cijkl[index(k,i)][index(j,l)]*a[l];
-    }
+  outbuf_str(out, atom_name);
+  for (int d=0; d<3; ++d) {
+    outbuf_char(out, ' ');
+    outbuf_lf(out, xyz[d], 0, 15);
   }
+  outbuf_char(out, '\n');
 }
 
+
 void print_mat (double a[9]) 
 {
   int i, j;
@@ -232,7 +286,7 @@ void print_mat (double a[9])
 
 // Arguments first, then flags, then explanation.
 const int NUMARGS = 6;
-const char* ARGLIST = "[-hvt] [-s STEPS] atomname cell infile Rcut undisloc disloc";
+const char* ARGLIST = "[-hvt] [-s STEPS] [-g NGAUSS [-p NPANELS]] [-e TOLER] [-x | -c] [-C CACHEDIR] [-S] [-z] atomname cell infile Rcut undisloc disloc";
 
 const int NFLAGS = 0;
 const char USERFLAGLIST[NFLAGS] = {}; // Would be the flag characters.
@@ -246,6 +300,14 @@ const char* ARGEXPL =
   disloc:   dislocated crystal output file (can be -)\n\
 \n\
   -s STEPS  number of integration steps\n\
+  -g NGAUSS  Gauss-Legendre integration, NGAUSS points per panel\n\
+  -p NPANELS number of Gauss panels (default 32; must divide STEPS)\n\
+  -e TOLER  adaptive Gauss-Legendre integration to relative tolerance TOLER\n\
+  -x        closed-form Stroh (sextic) solution; no theta integration\n\
+  -c        cross-check the Stroh solution against the integrals\n\
+  -C CACHEDIR keep the theta tables in CACHEDIR, and reuse them\n\
+  -S        stream the slab: generate, displace and write it a block at a time\n\
+  -z        displace the slab in Morton (Z-curve) order; output order is kept\n\
   -v        verbosity\n\
   -t        testing\n\
   -h        help";
@@ -281,13 +343,44 @@ int main ( int argc, char **argv )
   int TESTING = 0;  // Extreme verbosity (testing purposes)
   int ERROR = 0;    // Analysis: Error flag (for analysis purposes)
   int Nsteps = 16384; // 2^14, default
+  int Ngauss = 0;     // Gauss points per panel; 0 = Simpson stepper
+  int Npanels = 0;    // 0: default for the integration method
+  double toler = 0.;  // adaptive integration tolerance; 0 = fixed panels
+  int STROH = 0;      // STROH_SOLVE: closed-form; STROH_CHECK: compare
+  char* cachedir = NULL; // where to keep the theta tables
+  int STREAM = 0;     // never hold the whole slab in memory
+  int ZORDER = 0;     // work on the slab in Morton order
 
   char ch;
-  while ((ch = getopt(argc, argv, "vths:")) != -1) {
+  while ((ch = getopt(argc, argv, "vths:g:p:e:xcC:Sz")) != -1) {
     switch (ch) {
     case 's':
       Nsteps = (int)strtol(optarg, (char**)NULL, 10);
       break;
+    case 'g':
+      Ngauss = (int)strtol(optarg, (char**)NULL, 10);
+      break;
+    case 'p':
+      Npanels = (int)strtol(optarg, (char**)NULL, 10);
+      break;
+    case 'e':
+      toler = strtod(optarg, (char**)NULL);
+      break;
+    case 'x':
+      STROH = STROH_SOLVE;
+      break;
+    case 'c':
+      STROH = STROH_CHECK;
+      break;
+    case 'C':
+      cachedir = optarg;
+      break;
+    case 'S':
+      STREAM = 1;
+      break;
+    case 'z':
+      ZORDER = 1;
+      break;
     case 'v':
       VERBOSE = 1;
       break;
@@ -305,8 +398,16 @@ int main ( int argc, char **argv )
   argc -= optind; if (argc<NUMARGS && !ERROR) ERROR = 2;
   argv += optind;
 
+  if (toler > 0.) {
+    if (Ngauss <= 0) Ngauss = ADAPT_NGAUSS;
+    if (Npanels == 0) Npanels = ADAPT_NPANELS;
+  }
+  if (Npanels == 0) Npanels = DEFAULT_NPANELS;
+
   if (TESTING) {
     printf("# Nsteps=%d\n", Nsteps);
+    if (Ngauss > 0) printf("# Ngauss=%d Npanels=%d\n", Ngauss, Npanels);
+    if (toler > 0.) printf("# toler=%.3le\n", toler);
   }
   // We're going to use the number of steps according to our preferred
   // amount of memory allocation.
@@ -314,6 +415,11 @@ int main ( int argc, char **argv )
     fprintf(stderr, "Nsteps (%d) must be 4 or larger.\n", Nsteps);
     ERROR = 2;
   }  
+  if ( (Ngauss > 0) && ((Npanels < 1) || (Nsteps % Npanels != 0)) ) {
+    fprintf(stderr, "Npanels (%d) must be positive and divide Nsteps (%d).\n",
+	    Npanels, Nsteps);
+    ERROR = 2;
+  }
 
   // All hell broken loose yet?
   if (ERROR != 0) {
@@ -351,7 +457,7 @@ int main ( int argc, char **argv )
   double* Cmn_list; // elastic constant input
   double Cijkl[9][9];
   int Natoms;
-  double** u_atoms;
+  atom_list u_atoms;
 
   // disl. line, burgers vect, cut, center of dislocation (all in unit coord)
   int tu0[3], bu0[3], mu0[3], cu0[3]; // all in unit cell coord; must be int.
@@ -384,7 +490,7 @@ int main ( int argc, char **argv )
   }
 
   if (TESTING)
-    verbose_output_cell(cart, crystal, Cmn_list, u_atoms, Natoms);
+    verbose_output_cell(cart, crystal, Cmn_list, &u_atoms);
 
   // Now, read in the dislocation information
   infile = myopenr(infile_name);
@@ -504,139 +610,144 @@ int main ( int argc, char **argv )
   double dtheta;
   dtheta = M_PI / Nsteps;
   double mt[3], nt[3];
-  double nnt[9], mmt[9], nmt[9], mnt[9], nnti[9];
-  double detnn;
 
-  // We have to integrate three functions.
-  double **Nint, **Lint;
-  double Bint[9];
-
-  Nint = new double*[Nsteps+1];
-  Lint = new double*[Nsteps+1];
-  for (i=0; i<=Nsteps; ++i) {
-    Nint[i] = new double[9];
-    Lint[i] = new double[9];
-  }
-  
-  // Function evaluations, stored for integration purposes.
-  double nn_old[4][9], nnnm_old[4][9], mnnnnm_old[4][9];
-
-  // First, prime the integration pump:
-  for (k=1; k<=3; ++k) {
-    theta = -(k-1)*dtheta;
-    // Eval (nn), (nm), (mn), (mm), and (nn)^-1
-    m_theta(theta, m0, n0, mt);
-    n_theta(theta, m0, n0, nt);
-    a_mult_a(mt, Cijkl, mmt);
-    a_mult_a(nt, Cijkl, nnt);
-    a_mult_b(nt, mt, Cijkl, nmt);
-    transpose(nmt, mnt);
-    detnn = 1./inverse(nnt, nnti);
-    for (i=0; i<9; ++i) nnti[i] *= detnn;
-    // Now, put into the function evaluations:
-    for (i=0; i<9; ++i) nn_old[k][i] = nnti[i];
-    mult(nnti, nmt, nnnm_old[k]);
-    mult(mnt, nnnm_old[k], mnnnnm_old[k]);
-    for (i=0; i<9; ++i)
-      mnnnnm_old[k][i] = mmt[i] - mnnnnm_old[k][i];
-    // And HERE's where we'd integrate, if we wanted to... :)
-  }
-
-  // Now we've got EVERYTHING, let's integrate!
-  // theta = 0 is easy...
-  for (i=0; i<9; ++i) {
-    Nint[0][i] = 0.;
-    Lint[0][i] = 0.;
-    Bint[i] = 0.;
-  }
-
-  for (k=1; k<=Nsteps; ++k) {
-    theta = k*dtheta;
-    // Eval (nn), (nm), (mn), (mm), and (nn)^-1
-    m_theta(theta, m0, n0, mt);
-    n_theta(theta, m0, n0, nt);
-    a_mult_a(mt, Cijkl, mmt);
-    a_mult_a(nt, Cijkl, nnt);
-    a_mult_b(nt, mt, Cijkl, nmt);
-    transpose(nmt, mnt);
-    detnn = 1./inverse(nnt, nnti);
-    for (i=0; i<9; ++i) nnti[i] *= detnn;
-
-    // Now, put into the function evaluations:
-    for (i=0; i<9; ++i) nn_old[0][i] = nnti[i];
-    mult(nnti, nmt, nnnm_old[0]);
-    mult(mnt, nnnm_old[0], mnnnnm_old[0]);
-    for (i=0; i<9; ++i)
-      mnnnnm_old[0][i] = mmt[i] - mnnnnm_old[0][i];
-    // Now, we can integrate!
-    for (i=0; i<9; ++i) {
-      Nint[k][i] = Nint[k-1][i];
-      Lint[k][i] = Lint[k-1][i];
-      for (j=0; j<4; ++j) {
-	Nint[k][i] += dtheta*int_weight[j]*nn_old[j][i];
-	Lint[k][i] += dtheta*int_weight[j]*nnnm_old[j][i];
-	Bint[i]    += dtheta*int_weight[j]*mnnnnm_old[j][i];
-      }
+  // We have to integrate three functions...
+  double **Nint=NULL, **Lint=NULL;
+  double Sint[9], Bint[9];
+  int Neval;
+  // ...unless we use the closed-form solution:
+  stroh_solution stroh;
+  cplx stroh_c[3][3];
+
+  if (STROH) {
+    if (stroh_solve(Cijkl, m0, n0, stroh) != 0) {
+      fprintf(stderr, "Degenerate Stroh roots; integrating instead.\n");
+      STROH = 0;
     }
-    // Now, we slide down all of our "old" values:
-    for (j=3; j>0; --j)
+    else
+      stroh_coeff(stroh, b0, m0, n0, t0, stroh_c);
+  }
+  int TABLES = (STROH != STROH_SOLVE);  // do we need the theta tables?
+  int method = (toler > 0.) ? INTEGRATE_ADAPTIVE :
+    (Ngauss > 0) ? INTEGRATE_GAUSS : INTEGRATE_SIMPSON;
+
+  // ...or if a previous run already did the work:
+  table_key key;
+  table_cache cache;
+  char cachename[1024];
+  int CACHED = 0;
+  cache.map = NULL;
+  if (TABLES && (cachedir != NULL)) {
+    table_key_make(key, Cijkl, m0, n0, t0, b0,
+		   method, Nsteps, Npanels, Ngauss, toler);
+    table_cache_name(cachedir, key, cachename, sizeof(cachename));
+    CACHED = (table_cache_read(cachename, key, cache) == 0);
+    if (CACHED) {
       for (i=0; i<9; ++i) {
-	nn_old[j][i] = nn_old[j-1][i];
-	nnnm_old[j][i] = nnnm_old[j-1][i];
-	mnnnnm_old[j][i] = mnnnnm_old[j-1][i];
+	Sint[i] = cache.Sint[i];
+	Bint[i] = cache.Bint[i];
       }
-    // And do it all again!
+      if (VERBOSE) printf("# theta tables from %s\n", cachename);
+    }
   }
-  // Finally, define S, and scale everything appropriately.
-  double Sint[9];
 
-  for (k=0; k<=Nsteps; ++k)
-    for (i=0; i<9; ++i) 
-      Nint[k][i] *= (4.*M_PI);
-  
-  for (i=0; i<9; ++i) {
-    Sint[i] = -Lint[Nsteps][i] * M_1_PI;
-    Bint[i] *= 0.25*M_1_PI*M_1_PI;
-  }      
+  // The theta tables all go in one block (arena.H):
+  arena tables;
+  if (init_arena(tables, TABLES ? theta_tables_len(Nsteps) : 0) != 0) {
+    fprintf(stderr, "Not enough memory for the theta tables.\n");
+    exit(ERROR_MEMORY);
+  }
+  if (TABLES && !CACHED) {
+    Nint = arena_table(tables, Nsteps+1, 9);
+    Lint = arena_table(tables, Nsteps+1, 9);
+    if ( (Nint == NULL) || (Lint == NULL) ) {
+      fprintf(stderr, "Not enough memory for the theta tables.\n");
+      exit(ERROR_MEMORY);
+    }
+
+    Neval = integrate_angular(Cijkl, m0, n0, method,
+			      Nsteps, Npanels, Ngauss, toler,
+			      Nint, Lint, Sint, Bint);
+    if (TESTING) printf("# %d kernel evaluations\n", Neval);
+    if (toler > 0.)
+      fprintf(stderr, "# adaptive integration: %d panels of %d points, %d kernel evaluations\n",
+	      Npanels, Ngauss, Neval);
+  }
+  else if (!TABLES)
+    stroh_SB(stroh, Sint, Bint);
 
   // Displacement!
-  double** u;
+  double** u=NULL;
+  double** u_xyz=NULL;
   double NB[9], LS[9], sum[9];
-
-  u = new double*[Nsteps+1];
-  for (k=0; k<=Nsteps; ++k) {
-    u[k] = new double[3];
-    theta = k*dtheta;
-    // Eval. the theta part of u_i:
-    mult(Nint[k], Bint, NB);
-    mult(Lint[k], Sint, LS);
-    for (i=0; i<9; ++i) sum[i] = NB[i] + LS[i];
-    mult_vect(sum, b0, u[k]);
-    for (i=0; i<3; ++i) u[k][i] *= 0.5*M_1_PI;
-  }
-  
-  // Now, let's put those displacements into cylindrical coordinates:
-  double** u_xyz;
   double tmagn;
   tmagn = 1./sqrt(dot(t0,t0));
-  u_xyz = new double*[2*Nsteps+1];
-  for (k=0; k<=Nsteps; ++k) {
-    u_xyz[k] = new double[3];
-    u_xyz[k][0] = dot(u[k], m0);
-    u_xyz[k][1] = dot(u[k], n0);
-    u_xyz[k][2] = dot(u[k], t0) * tmagn;
+
+  if (TABLES && !CACHED) {
+    u = arena_table(tables, Nsteps+1, 3);
+    if (u == NULL) {
+      fprintf(stderr, "Not enough memory for the theta tables.\n");
+      exit(ERROR_MEMORY);
+    }
+    for (k=0; k<=Nsteps; ++k) {
+      theta = k*dtheta;
+      // Eval. the theta part of u_i:
+      mult(Nint[k], Bint, NB);
+      mult(Lint[k], Sint, LS);
+      for (i=0; i<9; ++i) sum[i] = NB[i] + LS[i];
+      mult_vect(sum, b0, u[k]);
+      for (i=0; i<3; ++i) u[k][i] *= 0.5*M_1_PI;
+    }
+
+    // Now, let's put those displacements into cylindrical coordinates:
+    u_xyz = arena_table(tables, 2*Nsteps+1, 3);
+    if (u_xyz == NULL) {
+      fprintf(stderr, "Not enough memory for the theta tables.\n");
+      exit(ERROR_MEMORY);
+    }
+    for (k=0; k<=Nsteps; ++k) {
+      u_xyz[k][0] = dot(u[k], m0);
+      u_xyz[k][1] = dot(u[k], n0);
+      u_xyz[k][2] = dot(u[k], t0) * tmagn;
+    }
+    for ( ; k<=(2*Nsteps); ++k) {
+      u_xyz[k][0] = dot(u[k-Nsteps], m0) + u_xyz[Nsteps][0];
+      u_xyz[k][1] = dot(u[k-Nsteps], n0) + u_xyz[Nsteps][1];
+      u_xyz[k][2] = dot(u[k-Nsteps], t0) * tmagn + u_xyz[Nsteps][2];
+    }
   }
-  for ( ; k<=(2*Nsteps); ++k) {
-    u_xyz[k] = new double[3];
-    u_xyz[k][0] = dot(u[k-Nsteps], m0) + u_xyz[Nsteps][0];
-    u_xyz[k][1] = dot(u[k-Nsteps], n0) + u_xyz[Nsteps][1];
-    u_xyz[k][2] = dot(u[k-Nsteps], t0) * tmagn + u_xyz[Nsteps][2];
+  if (CACHED) {
+    u_xyz = new double*[2*Nsteps+1];
+    for (k=0; k<=(2*Nsteps); ++k)
+      u_xyz[k] = cache.u_xyz + 3*k;
   }
+  else if (TABLES && (cachedir != NULL))
+    if (table_cache_write(cachename, key, Sint, Bint, u_xyz) != 0)
+      fprintf(stderr, "Could not write the theta tables to %s\n", cachename);
+  if (STROH == STROH_CHECK)
+    stroh_crosscheck(stroh, stroh_c, Sint, Bint, Nsteps, u_xyz, stderr);
 
   // ************************* CYLINDRICAL SLAB **********************
   int Nslab;
-  double** xyz;
-  double** xyz_d;
+  atom_list slab, slab_d;
+  slab_lattice lattice;
+  init_atom_list(slab);
+  init_atom_list(slab_d);
+
+  // The logarithmic part:
+  double u0[3], xyz0[3];
+  mult_vect(Sint, b0, u0);
+  for (i=0; i<3; ++i) u0[i] *= -0.5*M_1_PI;
+  xyz0[0] = dot(u0, m0);
+  xyz0[1] = dot(u0, n0);
+  xyz0[2] = dot(u0, t0)*tmagn;
+  // Our scaling factor:
+  double aln;
+  // double a0;
+  // a0 = exp( log(det(cart)/Natoms) / 3.);
+  // aln = -log(a0);
+  aln = - log(det(cart)/Natoms) / 3.;
+  double inv_dtheta = 1./dtheta;
   
   if (VERBOSE) {
      printf("# %17.12lf %17.12lf %17.12lf : normalized x axis\n", m0[0], m0[1], m0[2]);
@@ -644,68 +755,62 @@ int main ( int argc, char **argv )
      printf("# %17.12lf %17.12lf %17.12lf : normalized z axis\n",
             t0[0]/sqrt(dot(t0,t0)), t0[1]/sqrt(dot(t0,t0)), t0[2]/sqrt(dot(t0,t0))); 
   }
-  ERROR = construct_slab(t0, m0, n0, c0, Rcut, cart, u_atoms, Natoms,
-			 Nslab, xyz);
-  if (!ERROR) {
-    // Now, we need to do some analysis on our displacements; first,
-    // we need to calculate the distance from the dislocation,
-    // and the magical angle theta for each:
-    double* theta_i;
-    double* dist_i;
-    double min_dist;
-    theta_i = new double[Nslab];
-    dist_i = new double[Nslab];
-    min_dist = Rcut;
-    for (i=0; i<Nslab; ++i) {
-      dist_i[i] = sqrt( xyz[i][0]*xyz[i][0] + xyz[i][1]*xyz[i][1]);
-      if (dist_i[i] < min_dist) min_dist = dist_i[i];
-      theta_i[i] = atan2(xyz[i][1], xyz[i][0]) + M_PI/2.;
-      if (theta_i[i] < 0.) theta_i[i] += (2.*M_PI);
+  // We need to calculate the distance from the dislocation for each
+  // atom, and make sure none are right on it:
+  double min_dist = Rcut;
+  if (STREAM) {
+    // Just count, for now; the atoms come back again for the output.
+    init_slab_lattice(lattice, t0, m0, n0, c0, Rcut, cart, u_atoms);
+    double* block = new double[3*SLAB_BLOCK];
+    double *x = block, *y = block + SLAB_BLOCK, *z = y + SLAB_BLOCK;
+    slab_iter it;
+    int Nb;
+    Nslab = 0;
+    slab_begin(lattice, it);
+    while ( (Nb = slab_next(lattice, it, SLAB_BLOCK, x, y, z, NULL)) > 0) {
+      for (i=0; i<Nb; ++i) {
+	double dist = sqrt( x[i]*x[i] + y[i]*y[i]);
+	if (dist < min_dist) min_dist = dist;
+      }
+      Nslab += Nb;
     }
+    delete[] block;
+  }
+  else {
+    ERROR = construct_slab(t0, m0, n0, c0, Rcut, cart, u_atoms, slab);
+    Nslab = slab.N;
+    for (i=0; (i<Nslab) && !ERROR; ++i) {
+      double dist = sqrt( slab.x[i]*slab.x[i] + slab.y[i]*slab.y[i]);
+      if (dist < min_dist) min_dist = dist;
+    }
+    if (ZORDER && !ERROR) {
+      // Neighbors in space next to each other, for the theta tables:
+      int* perm = new int[Nslab];
+      morton_order(slab, perm);
+      ERROR = reorder_atom_list(slab, perm);
+      delete[] perm;
+    }
+  }
+  if (!ERROR) {
     ERROR = dcomp(min_dist, 0.);
-    if (ERROR) {
+    if (ERROR)
       fprintf(stderr, "You managed to center your dislocation right on an atom... that's not so good.\n");
-      xyz_d = NULL;
-    }
-    else {
-      // Now, let's treat the logarithmic part:
-      double u0[3], xyz0[3];
-      mult_vect(Sint, b0, u0);
-      for (i=0; i<3; ++i) u0[i] *= -0.5*M_1_PI;
-      xyz0[0] = dot(u0, m0);
-      xyz0[1] = dot(u0, n0);
-      xyz0[2] = dot(u0, t0)*tmagn;
-      // Our scaling factor:
-      double aln;
-      // double a0;
-      // a0 = exp( log(det(cart)/Natoms) / 3.);
-      // aln = -log(a0);
-      aln = - log(det(cart)/Natoms) / 3.;
-      
+    else if (!STREAM) {
       // Let's displace all of the atoms accordingly:
       // xyz0*(ln|x| - ln(a0)) + u_xyz(theta)
-      double lnr, kreal, inv_dtheta;
-      double alpha, beta;
-      xyz_d = new double*[Nslab];
-      inv_dtheta = 1./dtheta;
+      copy_atom_list(slab_d, slab);
       for (i=0; i<Nslab; ++i) {
-	xyz_d[i] = new double[3];
-	lnr = log(dist_i[i]) + aln;
-	// Now, linearly interpolate for theta:
-	kreal = theta_i[i] * inv_dtheta;
-	k = (int) kreal;
-	alpha = kreal - k;
-	beta = 1. - alpha;
-	for (j=0; j<3; ++j)
-	  xyz_d[i][j] = xyz[i][j] + xyz0[j]*lnr
-	    + beta*u_xyz[k][j] + alpha*u_xyz[k+1][j];
+	double xyz_i[3], xyz_d_i[3];
+	get_atom(slab, i, xyz_i);
+	displace_atom(xyz_i, xyz0, aln, stroh, stroh_c, u_xyz, inv_dtheta,
+		      xyz_d_i);
+	set_atom(slab_d, i, xyz_d_i);
       }
+      // ... and back in lattice order for the output:
+      if (ZORDER)
+	ERROR = restore_atom_order(slab) | restore_atom_order(slab_d);
     }
-    // Garbage collection...
-    delete[] theta_i;
-    delete[] dist_i;
   }
-  else xyz_d = NULL;
   
   // ****************************** OUTPUT ***************************
 
@@ -729,29 +834,35 @@ int main ( int argc, char **argv )
 	     dot(u0, tnorm), dot(u0, m0), dot(u0, n0));
       printf("# \n");
       
-      // Now, let's output it; next, just the angular part.
-      printf("# theta  u.t  u.m(theta)  u.n(theta)\n");
-      // 0..Pi
-      for (k=0; k<=Nsteps; ++k) {
-	theta = k*dtheta;
-	// For output in "dislocation coordinates":
-	m_theta(theta, m0, n0, mt);
-	n_theta(theta, m0, n0, nt);
-	printf("%10.7lf %.15lf %.15lf %.15lf\n", theta,
-	       dot(u[k], tnorm), dot(u[k], mt), dot(u[k], nt));
-      }
-      // Pi .. 2Pi
-      // We handle this simply adding in the u0 = u[Nsteps]
-      for (i=0; i<3; ++i) u0[i] = u[Nsteps][i];
-      for (k=1; k<=Nsteps; ++k) {
-	theta = k*dtheta + M_PI;
-	// For output in "dislocation coordinates":
-	m_theta(theta, m0, n0, mt);
-	n_theta(theta, m0, n0, nt);
-	printf("%10.7lf %.15lf %.15lf %.15lf\n", theta,
-	       dot(u[k], tnorm)+dot(u0,tnorm), 
-	       dot(u[k], mt)+dot(u0,mt),
-	       dot(u[k], nt)+dot(u0,nt));
+      if (!TABLES)
+	printf("# (Stroh solution; no theta tables to output)\n");
+      else if (CACHED)
+	printf("# (cached theta tables; no u(theta) to output)\n");
+      else {
+	// Now, let's output it; next, just the angular part.
+	printf("# theta  u.t  u.m(theta)  u.n(theta)\n");
+	// 0..Pi
+	for (k=0; k<=Nsteps; ++k) {
+	  theta = k*dtheta;
+	  // For output in "dislocation coordinates":
+	  m_theta(theta, m0, n0, mt);
+	  n_theta(theta, m0, n0, nt);
+	  printf("%10.7lf %.15lf %.15lf %.15lf\n", theta,
+	         dot(u[k], tnorm), dot(u[k], mt), dot(u[k], nt));
+	}
+	// Pi .. 2Pi
+	// We handle this simply adding in the u0 = u[Nsteps]
+	for (i=0; i<3; ++i) u0[i] = u[Nsteps][i];
+	for (k=1; k<=Nsteps; ++k) {
+	  theta = k*dtheta + M_PI;
+	  // For output in "dislocation coordinates":
+	  m_theta(theta, m0, n0, mt);
+	  n_theta(theta, m0, n0, nt);
+	  printf("%10.7lf %.15lf %.15lf %.15lf\n", theta,
+	         dot(u[k], tnorm)+dot(u0,tnorm), 
+	         dot(u[k], mt)+dot(u0,mt),
+	         dot(u[k], nt)+dot(u0,nt));
+	}
       }
     }
   }
@@ -761,51 +872,67 @@ int main ( int argc, char **argv )
   }
   else {
     // Output XYZ files!!
+    outbuf out;  // per-atom lines, through a big buffer (format.H)
+    double* block = STREAM ? new double[3*SLAB_BLOCK] : NULL;
+    double *x = block, *y = block + SLAB_BLOCK, *z = y + SLAB_BLOCK;
+    slab_iter it;
+    int Nb;
     // First, the undislocated slab:
     infile = myopenw(undisloc_name);
-    fprintf(infile, "%d\n", Nslab);
-    fprintf(infile, "%.15lf = z: undislocated slab, t = [%d %d %d], b = [%d %d %d]",
-	    sqrt(dot(t0,t0)),
-	    tu0[0], tu0[1], tu0[2], 
-	    bu0[0], bu0[1], bu0[2]);
-    if (bu_denom != 1) fprintf(infile, "/%d", bu_denom);
-    fprintf(infile, " Rmax = %.3lf\n", Rcut);
-    for (i=0; i<Nslab; ++i)
-      fprintf(infile, "%s %.15lf %.15lf %.15lf\n", atom_name,
-	      xyz[i][0], xyz[i][1], xyz[i][2]);
+    slab_header(infile, Nslab, "undislocated", t0, tu0, bu0, bu_denom, Rcut);
+    outbuf_open(out, infile);
+    if (STREAM) {
+      slab_begin(lattice, it);
+      while ( (Nb = slab_next(lattice, it, SLAB_BLOCK, x, y, z, NULL)) > 0)
+	for (i=0; i<Nb; ++i) {
+	  double xyz_i[3] = {x[i], y[i], z[i]};
+	  write_atom(out, atom_name, xyz_i);
+	}
+    }
+    else
+      for (i=0; i<Nslab; ++i) {
+	double xyz_i[3];
+	get_atom(slab, i, xyz_i);
+	write_atom(out, atom_name, xyz_i);
+      }
+    outbuf_close(out);
     myclose(infile);
     
     // Next, the dislocated slab:
     infile = myopenw(disloc_name);
-    fprintf(infile, "%d\n", Nslab);
-    fprintf(infile, "%.15lf = z: dislocated slab, t = [%d %d %d], b = [%d %d %d]",
-	    sqrt(dot(t0,t0)),
-	    tu0[0], tu0[1], tu0[2], 
-	    bu0[0], bu0[1], bu0[2]);
-    if (bu_denom != 1) fprintf(infile, "/%d", bu_denom);
-    fprintf(infile, " Rmax = %.3lf\n", Rcut);
-    for (i=0; i<Nslab; ++i)
-      fprintf(infile, "%s %.15lf %.15lf %.15lf\n", atom_name,
-	      xyz_d[i][0], xyz_d[i][1], xyz_d[i][2]);
+    slab_header(infile, Nslab, "dislocated", t0, tu0, bu0, bu_denom, Rcut);
+    outbuf_open(out, infile);
+    if (STREAM) {
+      slab_begin(lattice, it);
+      while ( (Nb = slab_next(lattice, it, SLAB_BLOCK, x, y, z, NULL)) > 0)
+	for (i=0; i<Nb; ++i) {
+	  double xyz_i[3] = {x[i], y[i], z[i]}, xyz_d_i[3];
+	  displace_atom(xyz_i, xyz0, aln, stroh, stroh_c, u_xyz, inv_dtheta,
+			xyz_d_i);
+	  write_atom(out, atom_name, xyz_d_i);
+	}
+    }
+    else
+      for (i=0; i<Nslab; ++i) {
+	double xyz_d_i[3];
+	get_atom(slab_d, i, xyz_d_i);
+	write_atom(out, atom_name, xyz_d_i);
+      }
+    outbuf_close(out);
     myclose(infile);
+    delete[] block;
   }
 
   // ************************* GARBAGE COLLECTION ********************
-  free_slab(Nslab, xyz);
-  free_slab(Nslab, xyz_d);
-  free_cell(Cmn_list, u_atoms, Natoms);
-  for (i=0; i<=(2*Nsteps); ++i)
-    delete[] u_xyz[i];
-  delete[] u_xyz;
-
-  for (i=0; i<=Nsteps; ++i) {
-    delete[] Nint[i];
-    delete[] Lint[i];
-    delete[] u[i];
-  }
-  delete[] u;
-  delete[] Nint;
-  delete[] Lint;
+  if (STREAM) free_slab_lattice(lattice);
+  free_atom_list(slab);
+  free_atom_list(slab_d);
+  free_cell(Cmn_list, u_atoms);
+  if (CACHED) {
+    delete[] u_xyz;
+    table_cache_close(cache);
+  }
+  free_arena(tables);
 
   delete[] Cmn_list;
 
@@ -9,11 +9,24 @@ cd bccFe
 ## self-consistently evaluate edge dislocation geometry
 ## the command line inputs to anisotropic-xyz-ref are:
 ## [cell file] [infile] [undislocated xyz file] [reference file =  dislocated xyz file from previous iteration]
+## -C tables keeps the integrated theta tables in tables/, so only the
+## first iteration has to integrate.
 
-../../anisotropic-xyz-ref cell_bccFe infile_bccedge_t0-11 perf perf > edge_1
+mkdir -p tables
+../../anisotropic-xyz-ref -C tables cell_bccFe infile_bccedge_t0-11 perf perf > edge_1
 for i in $(seq 1 9); do
-	../../anisotropic-xyz-ref cell_bccFe infile_bccedge_t0-11 perf edge_$(echo "$i") > edge_$(echo "$i+1" | bc)
+	../../anisotropic-xyz-ref -C tables cell_bccFe infile_bccedge_t0-11 perf edge_$(echo "$i") > edge_$(echo "$i+1" | bc)
 done
 
+## -b on make-slab and anisotropic-xyz-ref passes binary slabs between
+## the steps instead of XYZ text (any of the codes reads either), e.g.
+#../../make-slab -b cell_bccFe infile_bccedge_t0-11 300 > perf.slab
+#../../anisotropic-xyz-ref -b -C tables cell_bccFe infile_bccedge_t0-11 perf.slab perf.slab > edge_1.slab
+## and leave off -b on the last step to get an XYZ file.
+
+## or iterate to self-consistency in one process, stopping once no atom
+## moves more than 1e-8 (history on stderr):
+#../../anisotropic-xyz-ref -i 1e-8 cell_bccFe infile_bccedge_t0-11 perf perf > edge_sc
+
 ## compute and output strain
 #../../anisotropic-xyz-ref-outputstrain cell_bccFe infile_bccedge_t0-11 perf edge_10 strain > edge_11
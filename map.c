@@ -14,6 +14,10 @@
 	   -n    write text amount of burgers vector for each pair
 	   -b    write text for mini-burgers loops on triads
 	   -a    write the atom numbers on the atoms
+	   -j    use all of the processors for the NN search
+	   -z    work in Morton (Z-curve) atom order (atoms.H); the
+	         picture is the same, but the objects in the fig file
+	         come out in a different order
 
 
   Flags:   MEMORY:  the amount of space allocated; not used.
@@ -45,26 +49,29 @@
 #include <iostream>
 #include <iomanip>
 #include <math.h>
+#include <unistd.h>
 #include "io.H"   // All of our "read in file", etc.
 #include "drawfig.H"
 #include "nnpair.H"
+#include "atoms.H"
 
 // ****************************** SUBROUTINES **************************
 
 // Given a set of atoms, determines the ideal scale factor to maximize
 // space on the page, ideal atom size (can be recalculated later), and
 // portrait vs. landscape
-void auto_scale (int N, double** r, 
+void auto_scale (atom_list &r, 
 		 double &a0, double &x0, double &y0, double &r0, 
 		 int &portrait);
 
 // Determine the 2d NN list for our disc.
-void plane_nn_pair (int Natoms, double** r, double Rcut, int &NNpairs, 
-		    nn_pair_type* &nn_pair_list, int** &nn_list);
+void plane_nn_pair (atom_list &r, double Rcut, int &NNpairs, 
+		    nn_pair_type* &nn_pair_list, nn_list_type &nn_list,
+		    int Nthreads);
 
 // Construct the set of all right-handed triads:
 void make_triads (int Natoms, int NNpairs, nn_pair_type* nn_pair_list, 
-		  int** nn_list, int &Ntriad, int** &triad);
+		  nn_list_type &nn_list, int &Ntriad, int** &triad);
 
 
 /*================================= main ==================================*/
@@ -73,8 +80,8 @@ void make_triads (int Natoms, int NNpairs, nn_pair_type* nn_pair_list,
 const int NUMARGS = 4;
 const char* ARGLIST = "<perfect-xtal.file> <dislocated-xtal.file> <Rcut> <Rmax> [<scale>]";
 
-const int NFLAGS = 5;
-const char USERFLAGLIST[NFLAGS] = {'e', 'n', 'b', 'c', 'a'};
+const int NFLAGS = 7;
+const char USERFLAGLIST[NFLAGS] = {'e', 'n', 'b', 'c', 'a', 'j', 'z'};
 
 const char* ARGEXPL = 
 "  perfect-xtal:     XYZ file for perfect crystal\n\
@@ -86,7 +93,9 @@ const char* ARGEXPL =
   -n     write text amount of burgers vector for each pair\n\
   -b     write text for mini-burgers loops on triads\n\
   -c     color triads by how \"bulk-like\" they are\n\
-  -a     write the atom numbers on the atoms";
+  -a     write the atom numbers on the atoms\n\
+  -j     use all of the processors for the NN search\n\
+  -z     put the atoms in Morton order first (same picture)";
 
 int main ( int argc, char **argv ) 
 {
@@ -120,8 +129,8 @@ int main ( int argc, char **argv )
   FILE* disloc_file;
 
   int Natoms;
-  double** pos;
-  double** pos_d;
+  atom_list pos;      // x, y, z of each atom, one array each (atoms.H)
+  atom_list pos_d;
   double Rcut, Rmax;
   double z_thick;
   double burgers;
@@ -131,6 +140,12 @@ int main ( int argc, char **argv )
   int TRIADS = FLAGON[2];
   int BULKCOLOR = FLAGON[3];
   int ATOMNUMS = FLAGON[4];
+  int ZORDER = FLAGON[6];
+  int Nthreads = 1;
+  if (FLAGON[5]) {
+    Nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (Nthreads < 1) Nthreads = 1;
+  }
 
   sscanf(args[2], "%lf", &Rcut);
   sscanf(args[3], "%lf", &Rmax);
@@ -171,13 +186,13 @@ int main ( int argc, char **argv )
   // Do all the reading now!
   if (!ERROR) {
     char null[512];
-    pos = new double*[Natoms];
+    alloc_atom_list(pos, Natoms);
     // ==== Perfect file ====
     for (i=0; i<Natoms; ++i) {
-      pos[i] = new double[3];
       // <name> x y z
       fgets(dump, sizeof(dump), perfect_file);
-      sscanf(dump, "%s %lf %lf %lf", null, pos[i], pos[i]+1, pos[i]+2);
+      sscanf(dump, "%s %lf %lf %lf", null, pos.x+i, pos.y+i, pos.z+i);
+      pos.type[i] = 0;
     }
   }
   myclose(perfect_file);
@@ -213,26 +228,26 @@ int main ( int argc, char **argv )
   // Do all the reading now!
   if (!ERROR) {
     char null[512];
-    pos_d = new double*[Natoms];
+    alloc_atom_list(pos_d, Natoms);
     // ==== Dislocated file ====
     for (i=0; i<Natoms; ++i) {
-      pos_d[i] = new double[3];
       // <name> x y z
       fgets(dump, sizeof(dump), disloc_file);
-      sscanf(dump, "%s %lf %lf %lf", null, pos_d[i], pos_d[i]+1, pos_d[i]+2);
+      sscanf(dump, "%s %lf %lf %lf", null, pos_d.x+i, pos_d.y+i, pos_d.z+i);
+      pos_d.type[i] = 0;
     }
 
     // Calc. COM shift, and set to 0.
-    double COM[3];
-    for (j=0; j<3; ++j) COM[j] = 0.;
-    for (i=0; i<Natoms; ++i) for(j=0; j<3; ++j) COM[j] += pos[i][j];
-    for (j=0; j<3; ++j) COM[j] /= Natoms;
-    for (i=0; i<Natoms; ++i) for(j=0; j<3; ++j) pos[i][j] -= COM[j];
-
-    for (j=0; j<3; ++j) COM[j] = 0.;
-    for (i=0; i<Natoms; ++i) for(j=0; j<3; ++j) COM[j] += pos_d[i][j];
-    for (j=0; j<3; ++j) COM[j] /= Natoms;
-    for (i=0; i<Natoms; ++i) for(j=0; j<3; ++j) pos_d[i][j] -= COM[j];
+    atom_list* list[2] = {&pos, &pos_d};
+    for (int l=0; l<2; ++l) {
+      double* coord[3] = {list[l]->x, list[l]->y, list[l]->z};
+      for (j=0; j<3; ++j) {
+	double COM = 0.;
+	for (i=0; i<Natoms; ++i) COM += coord[j][i];
+	COM /= Natoms;
+	for (i=0; i<Natoms; ++i) coord[j][i] -= COM;
+      }
+    }
   }
 
   myclose(disloc_file);
@@ -247,27 +262,44 @@ int main ( int argc, char **argv )
   MEMORY = Natoms; // Keep track of total amount allocated...
   Natoms = 0;
   for (i=0; i<MEMORY; ++i) {
-    if ( (pos[i][0]*pos[i][0]+pos[i][1]*pos[i][1]) <= Rmax2 ) {
+    if ( (pos.x[i]*pos.x[i]+pos.y[i]*pos.y[i]) <= Rmax2 ) {
       // Keep this atom!
       if (i == Natoms)
 	++Natoms; // No copying to do...
       else {
 	// Shift atom i to position Natoms:
-	for (j=0; j<3; ++j) {
-	  pos[Natoms][j] = pos[i][j];
-	  pos_d[Natoms][j] = pos_d[i][j];
-	}
+	pos.x[Natoms] = pos.x[i];
+	pos.y[Natoms] = pos.y[i];
+	pos.z[Natoms] = pos.z[i];
+	pos_d.x[Natoms] = pos_d.x[i];
+	pos_d.y[Natoms] = pos_d.y[i];
+	pos_d.z[Natoms] = pos_d.z[i];
 	++Natoms;
       }
     }
   }
+  pos.N = Natoms;     // the ones we kept; the rest are just left over
+  pos_d.N = Natoms;
+
+  if (ZORDER) {
+    // Same order for both, so neighbors in the plane are neighbors
+    // in memory; tag is the atom number from before.
+    int* perm = new int[Natoms];
+    morton_order(pos, perm);
+    if ( (reorder_atom_list(pos, perm) != 0)
+	 || (reorder_atom_list(pos_d, perm) != 0) ) {
+      fprintf(stderr, "Not enough memory to reorder the atoms.\n");
+      exit(-1);
+    }
+    delete[] perm;
+  }
 
   // *********************** DIFF DISP ANALYSIS **********************
   
   double* disp_z;
   disp_z = new double[Natoms];
   for (i=0; i<Natoms; ++i)
-    disp_z[i] = pos_d[i][2] - pos[i][2];
+    disp_z[i] = pos_d.z[i] - pos.z[i];
 
 
   // *************************** NN ANALYSIS *************************
@@ -276,16 +308,16 @@ int main ( int argc, char **argv )
   // in another routine, and for good reason.
   nn_pair_type* nn_pair_list;
   int NNpairs;
-  int** nn_list = NULL;
+  nn_list_type nn_list;
 
-  plane_nn_pair (Natoms, pos, Rcut, NNpairs, nn_pair_list, nn_list);
+  plane_nn_pair (pos, Rcut, NNpairs, nn_pair_list, nn_list, Nthreads);
 
   // ****************************** OUTPUT ***************************
   // Autoscale that sucker!
   double a0, x0, y0, r_atom;
   int portrait;
   
-  auto_scale(Natoms, pos, a0, x0, y0, r_atom, portrait);
+  auto_scale(pos, a0, x0, y0, r_atom, portrait);
 
   // Declare a figure drawing object.
   drawfig draw(stdout, portrait, a0, x0, y0);
@@ -296,18 +328,18 @@ int main ( int argc, char **argv )
   // Output all of the atoms:
   for (i=0; i<Natoms; ++i) {
     // Set fillstyle based on depth:
-    draw.fillstyle(GREEN, (int)(WHITEFILL*insidecell(pos[i][2]/z_thick)) );
-    draw.circle(pos[i][0], pos[i][1], r_atom);
+    draw.fillstyle(GREEN, (int)(WHITEFILL*insidecell(pos.z[i]/z_thick)) );
+    draw.circle(pos.x[i], pos.y[i], r_atom);
     if(ATOMNUMS) {
-      sprintf(dump, "%d", i+1);
-      draw.text(pos[i][0], pos[i][1]-2.0*r_atom, dump);
+      sprintf(dump, "%d", ((pos.tag != NULL) ? pos.tag[i] : i) + 1);
+      draw.text(pos.x[i], pos.y[i]-2.0*r_atom, dump);
     }
   }
   
 
   // Now, let's do the differential displacements.
-  // For now, this is going to do each vector *twice*, but we'll
-  // deal with that later.
+  // The list is a half list (nn_grid(..., NN_HALF)), so each bond
+  // comes up once, with j > i.
   // Run over all of the "bonds" in our list:
   draw.depth(draw.depth()+1);
   double zdisp;
@@ -325,39 +357,36 @@ int main ( int argc, char **argv )
     draw.textstyle(FONT_COURIER, 6.);
   for (i=0; i<NNpairs; ++i) {
     nn_pair = nn_pair_list + i;
-    // Only do the pairs where j > i (ensures that we don't double count):
-    if (nn_pair->j > nn_pair->i) {
-      zdisp = disp_z[nn_pair->j] - disp_z[nn_pair->i];
+    zdisp = disp_z[nn_pair->j] - disp_z[nn_pair->i];
       
-      // Make sure that it's between -1/2 burgers and 1/2 burgers:
-      for ( ; (2.*zdisp) > (burgers+TOLER); zdisp -= burgers) ;
-      for ( ; (2.*zdisp) <= -(burgers+TOLER); zdisp += burgers) ;
-      // Now, scale zdisp by burgers vector, and our scale factor
-      zdisp *= 1./burgers * scale;
-
-      if (!EDGE_COMP) {
-	x = 0.5*(pos[nn_pair->i][0] + pos[nn_pair->j][0]);
-	y = 0.5*(pos[nn_pair->i][1] + pos[nn_pair->j][1]);
-	vx = nn_pair->v_ij[0] * nn_pair->r;
-	vy = nn_pair->v_ij[1] * nn_pair->r;
-      }
-      else {
-	x = 0.5*(pos_d[nn_pair->i][0] + pos_d[nn_pair->j][0]);
-	y = 0.5*(pos_d[nn_pair->i][1] + pos_d[nn_pair->j][1]);
-	vx = pos_d[nn_pair->j][0] - pos_d[nn_pair->i][0];
-	vy = pos_d[nn_pair->j][1] - pos_d[nn_pair->i][1];
-      }
-      // dscale determines what length of b is equal to the nn dist:
-      draw.cvector(x, y, zdisp*vx/dscale, zdisp*vy/dscale);
-      if (NUMBERS) {
-	// Output a number there too.
-	if (fabs(zdisp) >= 0.01) {
-	  if (scale == 1)
-	    sprintf(dump, "%.0lf%%", fabs(zdisp)*100.);
-	  else
-	    sprintf(dump, "%.1le", fabs(zdisp/scale));
-	  draw.text(x, y, dump);
-	}
+    // Make sure that it's between -1/2 burgers and 1/2 burgers:
+    for ( ; (2.*zdisp) > (burgers+TOLER); zdisp -= burgers) ;
+    for ( ; (2.*zdisp) <= -(burgers+TOLER); zdisp += burgers) ;
+    // Now, scale zdisp by burgers vector, and our scale factor
+    zdisp *= 1./burgers * scale;
+
+    if (!EDGE_COMP) {
+      x = 0.5*(pos.x[nn_pair->i] + pos.x[nn_pair->j]);
+      y = 0.5*(pos.y[nn_pair->i] + pos.y[nn_pair->j]);
+      vx = nn_pair->v_ij[0] * nn_pair->r;
+      vy = nn_pair->v_ij[1] * nn_pair->r;
+    }
+    else {
+      x = 0.5*(pos_d.x[nn_pair->i] + pos_d.x[nn_pair->j]);
+      y = 0.5*(pos_d.y[nn_pair->i] + pos_d.y[nn_pair->j]);
+      vx = pos_d.x[nn_pair->j] - pos_d.x[nn_pair->i];
+      vy = pos_d.y[nn_pair->j] - pos_d.y[nn_pair->i];
+    }
+    // dscale determines what length of b is equal to the nn dist:
+    draw.cvector(x, y, zdisp*vx/dscale, zdisp*vy/dscale);
+    if (NUMBERS) {
+      // Output a number there too.
+      if (fabs(zdisp) >= 0.01) {
+	if (scale == 1)
+	  sprintf(dump, "%.0lf%%", fabs(zdisp)*100.);
+	else
+	  sprintf(dump, "%.1le", fabs(zdisp/scale));
+	draw.text(x, y, dump);
       }
     }
   }
@@ -390,8 +419,8 @@ int main ( int argc, char **argv )
       if ( TRIADS && (fabs(zdisp) >= 0.01) ) {
 	sprintf(dump, "%.0lf%%", zdisp*100.);
 	draw.depth(depthbase+1); // lower depth
-	draw.text( (pos[i][0]+pos[j][0]+pos[k][0])/3.,
-		   (pos[i][1]+pos[j][1]+pos[k][1])/3.,
+	draw.text( (pos.x[i]+pos.x[j]+pos.x[k])/3.,
+		   (pos.y[i]+pos.y[j]+pos.y[k])/3.,
 		   dump);
       }
       if (BULKCOLOR) {
@@ -407,9 +436,9 @@ int main ( int argc, char **argv )
 	// 	for (n=0; n<3; ++n) zd[n] -= 1./3.;
 	// 	del = 1.5*sqrt(zd[0]*zd[0] + zd[1]*zd[1] + zd[2]*zd[2]);
 
-	ui[0] = insidecell((pos_d[i][2]-pos_d[j][2])/burgers);
-	ui[1] = insidecell((pos_d[j][2]-pos_d[k][2])/burgers);
-	ui[2] = insidecell((pos_d[k][2]-pos_d[i][2])/burgers);
+	ui[0] = insidecell((pos_d.z[i]-pos_d.z[j])/burgers);
+	ui[1] = insidecell((pos_d.z[j]-pos_d.z[k])/burgers);
+	ui[2] = insidecell((pos_d.z[k]-pos_d.z[i])/burgers);
 	for (n=0; n<3; ++n) if (ui[n]<0) ui[n] += 1.;
 	if (! dcomp(ui[0]+ui[1]+ui[2], 1.))
 	  for (n=0; n<3; ++n) ui[n] = 1.-ui[n];
@@ -427,8 +456,8 @@ int main ( int argc, char **argv )
 	draw.pencolor(WHITE);
 	draw.linethickness(0);
 	draw.depth(depthbase+2); // even lower depth
-	draw.triangle(pos[i][0],pos[i][1], pos[j][0],pos[j][1], 
-		      pos[k][0],pos[k][1]);
+	draw.triangle(pos.x[i],pos.y[i], pos.x[j],pos.y[j], 
+		      pos.x[k],pos.y[k]);
 	draw.pencolor(BLACK);
 	draw.linethickness(1);
       }
@@ -442,15 +471,11 @@ int main ( int argc, char **argv )
 
   // ************************* GARBAGE COLLECTION ********************
   delete[] disp_z;
-  free_nn_list(Natoms, nn_list);
+  free_nn_list(nn_list);
   delete[] nn_pair_list;
 
-  for (i=0; i<MEMORY; ++i) { // Remember, we read more than we needed.
-    delete[] pos[i];
-    delete[] pos_d[i];
-  }
-  delete[] pos;
-  delete[] pos_d;
+  free_atom_list(pos);
+  free_atom_list(pos_d);
     
   return 0;
 }
@@ -470,26 +495,24 @@ const double R0_FRAC = 0.1;
 const double MINSCALE = 1.e-7;
 const double MAXSCALE = 1.e100;
 
-void auto_scale (int N, double** r, 
+void auto_scale (atom_list &r, 
 		 double &a0, double &x0, double &y0, double &r0, 
 		 int &portrait) 
 {
-  int i;
+  int i, N = r.N;
   double xmin, xmax, ymin, ymax;
-  double *rp;
   double xs, ys;     // Scale factors in each direction
   double a0_p, a0_l; // Scale factor for portrait vs. landscape
   
   
-  xmin = r[0][0]; xmax = r[0][0];
-  ymin = r[0][1]; ymax = r[0][1];
+  xmin = r.x[0]; xmax = r.x[0];
+  ymin = r.y[0]; ymax = r.y[0];
   
   for (i=0; i<N; ++i) {
-    rp = r[i];
-    if (rp[0] < xmin) xmin = rp[0];
-    if (rp[0] > xmax) xmax = rp[0];
-    if (rp[1] < ymin) ymin = rp[1];
-    if (rp[1] > ymax) ymax = rp[1];
+    if (r.x[i] < xmin) xmin = r.x[i];
+    if (r.x[i] > xmax) xmax = r.x[i];
+    if (r.y[i] < ymin) ymin = r.y[i];
+    if (r.y[i] > ymax) ymax = r.y[i];
   }
   
   x0 = 0.5*(xmax+xmin);
@@ -530,26 +553,25 @@ void auto_scale (int N, double** r,
 // attention.  At no time will my hands leave my wrists.
 // Basically, we make a bounding box that's just a little too big,
 // project out the z component, convert into "unit" coordinates, and
-// feed to the NN engine.
+// feed to the NN engine (on Nthreads threads).
 // Most efficient method?  Probably not.
 // Quick to code?  Relatively speaking, yes.
 // My apologies in advance...
-void plane_nn_pair (int N, double** r, double Rcut, int &NNpairs, 
-		    nn_pair_type* &nn_pair_list, int** &nn_list) 
+void plane_nn_pair (atom_list &r, double Rcut, int &NNpairs, 
+		    nn_pair_type* &nn_pair_list, nn_list_type &nn_list,
+		    int Nthreads) 
 {
-  int i;
+  int i, N = r.N;
   double xmin, xmax, ymin, ymax;
-  double* rp;
 
-  xmin = r[0][0]; xmax = r[0][0];
-  ymin = r[0][1]; ymax = r[0][1];
+  xmin = r.x[0]; xmax = r.x[0];
+  ymin = r.y[0]; ymax = r.y[0];
   
   for (i=0; i<N; ++i) {
-    rp = r[i];
-    if (rp[0] < xmin) xmin = rp[0];
-    if (rp[0] > xmax) xmax = rp[0];
-    if (rp[1] < ymin) ymin = rp[1];
-    if (rp[1] > ymax) ymax = rp[1];
+    if (r.x[i] < xmin) xmin = r.x[i];
+    if (r.x[i] > xmax) xmax = r.x[i];
+    if (r.y[i] < ymin) ymin = r.y[i];
+    if (r.y[i] > ymax) ymax = r.y[i];
   }
 
   // Now, make the "supercell"
@@ -567,13 +589,13 @@ void plane_nn_pair (int N, double** r, double Rcut, int &NNpairs,
   cart[8] = Lz;
 
   // "Populate" it.
-  double** u;
-  u = new double*[N];
+  atom_list u;
+  alloc_atom_list(u, N);
   for (i=0; i<N; ++i) {
-    u[i] = new double[3];
-    u[i][0] = insidecell( r[i][0] * Lx1 );
-    u[i][1] = insidecell( r[i][1] * Ly1 );
-    u[i][2] = 0.;
+    u.x[i] = insidecell( r.x[i] * Lx1 );
+    u.y[i] = insidecell( r.y[i] * Ly1 );
+    u.z[i] = 0.;
+    u.type[i] = r.type[i];
   }
 
   // Now, do the NN analysis!
@@ -581,25 +603,23 @@ void plane_nn_pair (int N, double** r, double Rcut, int &NNpairs,
   calc_grid(cart, Rcut, Ngrid);
   grid_elem_type* grid_list;
   make_grid(Ngrid, grid_list);
-  populate_grid(Ngrid, grid_list, N, u);
-  nn_grid(cart, Ngrid[0]*Ngrid[1]*Ngrid[2], grid_list, N, u, Rcut,
-	  NNpairs, nn_pair_list);
+  populate_grid(Ngrid, grid_list, u, Nthreads);
+  nn_grid(cart, Ngrid[0]*Ngrid[1]*Ngrid[2], grid_list, u, Rcut,
+	  NNpairs, nn_pair_list, NN_HALF, Nthreads);
   // Garbage collection
   free_grid(Ngrid, grid_list);
-  // NOTE: we ASSUME that nn_list == NULL here!
   sort_nn_list(NNpairs, nn_pair_list, N, nn_list);
 
   // Garbage collection:
-  for (i=0; i<N; ++i)
-    delete[] u[i];
-  delete[] u;    
+  free_atom_list(u);
 }
 
 
 // =============================== triads ==============================
-// Construct the set of all right-handed triads:
+// Construct the set of all right-handed triads; nn_list is a half
+// list, so each triad turns up once, as i < j < k:
 void make_triads (int Natoms, int NNpairs, nn_pair_type* nn_pair_list, 
-		  int** nn_list, int& Ntriad, int** &triad) 
+		  nn_list_type &nn_list, int& Ntriad, int** &triad) 
 {
   int i, j, k;
   int Napprox;
@@ -613,38 +633,34 @@ void make_triads (int Natoms, int NNpairs, nn_pair_type* nn_pair_list,
   nn_pair_type *pij, *pjk;
   int found;
   for (i=0; i<Natoms; ++i) {
-    for (ni=1; ni<=nn_list[i][0]; ++ni) {
-      pij = nn_pair_list + nn_list[i][ni];
+    for (ni=nn_list.start[i]; ni<nn_list.start[i+1]; ++ni) {
+      pij = nn_pair_list + nn_list.pair[ni];
       j = pij->j;
-      if (i < j) {
-	for (nj=1; nj<=nn_list[j][0]; ++nj) {
-	  pjk = nn_pair_list + nn_list[j][nj];
-	  k = pjk->j;
-	  if (j < k) {
-	    // Now, see if k has i for a neighbor:
-	    found = 0;
-	    for (nk=1; (nk<=nn_list[k][0]) && (!found); ++nk)
-	      found = (i == nn_pair_list[nn_list[k][nk]].j);
-	    if (found) {
-	      // Add our triad
-	      if (Ntriad >= Napprox) {
-		fprintf(stderr, "Too many triads; set Rcut smaller.\n");
-		return;
-	      }
-	      triad[0][Ntriad] = i;
-	      // Make sure we're right handed.
-	      if ( (pij->v_ij[0] * pjk->v_ij[1]) >
-		   (pij->v_ij[1] * pjk->v_ij[0]) ) {
-		triad[1][Ntriad] = j;
-		triad[2][Ntriad] = k;
-	      }
-	      else {
-		triad[1][Ntriad] = k;
-		triad[2][Ntriad] = j;
-	      }
-	      ++Ntriad;
-	    }
+      for (nj=nn_list.start[j]; nj<nn_list.start[j+1]; ++nj) {
+	pjk = nn_pair_list + nn_list.pair[nj];
+	k = pjk->j;
+	// Now, see if i has k for a neighbor:
+	found = 0;
+	for (nk=nn_list.start[i]; (nk<nn_list.start[i+1]) && (!found); ++nk)
+	  found = (k == nn_pair_list[nn_list.pair[nk]].j);
+	if (found) {
+	  // Add our triad
+	  if (Ntriad >= Napprox) {
+	    fprintf(stderr, "Too many triads; set Rcut smaller.\n");
+	    return;
+	  }
+	  triad[0][Ntriad] = i;
+	  // Make sure we're right handed.
+	  if ( (pij->v_ij[0] * pjk->v_ij[1]) >
+	       (pij->v_ij[1] * pjk->v_ij[0]) ) {
+	    triad[1][Ntriad] = j;
+	    triad[2][Ntriad] = k;
+	  }
+	  else {
+	    triad[1][Ntriad] = k;
+	    triad[2][Ntriad] = j;
 	  }
+	  ++Ntriad;
 	}
       }
     }